@@ -2,5 +2,6 @@
 #define BUILD_CONFIG_H
 
 // #define WITH_AUDIO
+// #define WITH_LATENCY_PROBE  // (on both sides)
 
 #endif  // BUILD_CONFIG_H
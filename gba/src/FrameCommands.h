@@ -0,0 +1,202 @@
+#ifndef FRAME_COMMANDS_H
+#define FRAME_COMMANDS_H
+
+#include <tonc.h>
+
+#include "Palette.h"
+#include "Protocol.h"
+#include "RuntimeConfig.h"
+#include "Utils.h"
+#include "_state.h"
+
+namespace FrameCommands {
+
+CODE_IWRAM void scroll(s32 dx, s32 dy) {
+  // (rows are moved in the same order as the RPI, so exposed pixels keep
+  //  their old values on both sides)
+  s32 offsetX = dx * (s32)RENDER_MODE_SCALEX[config.renderMode];
+  s32 offsetY = dy * (s32)RENDER_MODE_SCALEY[config.renderMode];
+  s32 fromX = max(offsetX, 0);
+  s32 toX = min(DRAW_WIDTH + offsetX, DRAW_WIDTH);
+  u8* screen = (u8*)vid_mem_front;
+  u32 sourceLine[DRAW_WIDTH / 4];
+  u32 targetLine[DRAW_WIDTH / 4];
+
+  for (s32 i = 0; i < DRAW_HEIGHT; i++) {
+    s32 y = offsetY > 0 ? DRAW_HEIGHT - 1 - i : i;
+    s32 sourceY = y - offsetY;
+    if (sourceY < 0 || sourceY >= DRAW_HEIGHT)
+      continue;
+
+    u8* target = screen + y * DRAW_WIDTH;
+    u8* source = screen + sourceY * DRAW_WIDTH;
+    if (offsetX == 0) {
+      memcpy32(target, source, DRAW_WIDTH / 4);
+      continue;
+    }
+
+    // (VRAM doesn't support 8-bit writes, so odd offsets are shifted in IWRAM)
+    memcpy32(sourceLine, source, DRAW_WIDTH / 4);
+    memcpy32(targetLine, target, DRAW_WIDTH / 4);
+    for (s32 x = fromX; x < toX; x++)
+      ((u8*)targetLine)[x] = ((u8*)sourceLine)[x - offsetX];
+    memcpy32(target, targetLine, DRAW_WIDTH / 4);
+  }
+}
+
+CODE_IWRAM void copyBlock(u32 blockX, u32 blockY, s32 dx, s32 dy) {
+  // (the whole source block is read before writing, like the RPI does)
+  u32 scaleX = RENDER_MODE_SCALEX[config.renderMode];
+  u32 scaleY = RENDER_MODE_SCALEY[config.renderMode];
+  u32 x = blockX * BLOCK_SIZE * scaleX;
+  u32 y = blockY * BLOCK_SIZE * scaleY;
+  if (x >= DRAW_WIDTH || y >= DRAW_HEIGHT)
+    return;
+
+  u32 blockWidth = min(BLOCK_SIZE * scaleX, DRAW_WIDTH - x);
+  u32 blockHeight = min(BLOCK_SIZE * scaleY, DRAW_HEIGHT - y);
+  u8* screen = (u8*)vid_mem_front;
+  u8* source = screen + (y - dy * scaleY) * DRAW_WIDTH + x - dx * scaleX;
+  u16* target = (u16*)(screen + y * DRAW_WIDTH + x);
+  u16 block[(BLOCK_SIZE * 4) * (BLOCK_SIZE * 4) / 2];  // (max scale is 4)
+  u32 halfWords = blockWidth / 2;
+
+  // (the source can be misaligned, so it's read byte by byte)
+  for (u32 row = 0; row < blockHeight; row++) {
+    u8* sourceRow = source + row * DRAW_WIDTH;
+    u16* blockRow = block + row * halfWords;
+    for (u32 i = 0; i < halfWords; i++)
+      blockRow[i] = sourceRow[i * 2] | (sourceRow[i * 2 + 1] << 8);
+  }
+
+  for (u32 row = 0; row < blockHeight; row++)
+    memcpy16(target + row * (DRAW_WIDTH / 2), block + row * halfWords,
+             halfWords);
+}
+
+ALWAYS_INLINE void fill(u8 color) {
+  dma3_fill(vid_mem_front, color * 0x01010101, DRAW_WIDTH * DRAW_HEIGHT);
+}
+
+ALWAYS_INLINE void storeReference(u32 slot) {
+  memcpy32(references[slot], vid_mem_front, TOTAL_SCREEN_PIXELS / 4);
+}
+
+CODE_IWRAM void restoreBlock(u32 slot, u32 blockX, u32 blockY) {
+  u32 scaleX = RENDER_MODE_SCALEX[config.renderMode];
+  u32 scaleY = RENDER_MODE_SCALEY[config.renderMode];
+  u32 x = blockX * BLOCK_SIZE * scaleX;
+  u32 y = blockY * BLOCK_SIZE * scaleY;
+  if (x >= DRAW_WIDTH || y >= DRAW_HEIGHT)
+    return;
+
+  u32 blockWidth = min(BLOCK_SIZE * scaleX, DRAW_WIDTH - x);
+  u32 blockHeight = min(BLOCK_SIZE * scaleY, DRAW_HEIGHT - y);
+  u16* source = (u16*)((u8*)references[slot] + y * DRAW_WIDTH + x);
+  u16* target = (u16*)((u8*)vid_mem_front + y * DRAW_WIDTH + x);
+
+  for (u32 row = 0; row < blockHeight; row++)
+    memcpy16(target + row * (DRAW_WIDTH / 2), source + row * (DRAW_WIDTH / 2),
+             blockWidth / 2);
+}
+
+ALWAYS_INLINE void setRenderMode(u32 renderMode) {
+  config.renderMode = renderMode;
+  setMosaic(RENDER_MODE_SCALEX[renderMode],
+            config.scanlines ? 1 : RENDER_MODE_SCALEY[renderMode]);
+}
+
+ALWAYS_INLINE void setPaletteColor(u32 index, u16 color) {
+  ((u16*)palette)[index] = color;
+}
+
+ALWAYS_INLINE void uploadPalette() {
+  // (it's uploaded right before rendering, so the new pixels are never shown
+  //  with the old colors)
+  dma3_cpy(pal_bg_mem, palette, sizeof(COLOR) * PALETTE_COLORS);
+}
+
+ALWAYS_INLINE void resetPalette() {
+  dma3_cpy(palette, MAIN_PALETTE, sizeof(COLOR) * PALETTE_COLORS);
+  dma3_cpy(pal_bg_mem, MAIN_PALETTE, sizeof(COLOR) * PALETTE_COLORS);
+}
+
+ALWAYS_INLINE void run() {
+  bool hasPaletteChanges = false;
+
+  for (u32 i = 0; i < state.commandPackets; i++) {
+    u32 command = commands[i];
+
+    switch (command >> COMMAND_ID_BIT_OFFSET) {
+      case COMMAND_SCROLL: {
+        s8 dx = command & 0xff;
+        s8 dy = (command >> 8) & 0xff;
+        if (dx != 0 || dy != 0)
+          scroll(dx, dy);
+        break;
+      }
+      case COMMAND_COPY_BLOCK: {
+        u32 blockX = command & 0b11111;
+        u32 blockY = (command >> 5) & 0b11111;
+        s32 dx = ((s32)(command << 16)) >> 26;
+        s32 dy = ((s32)(command << 10)) >> 26;
+        copyBlock(blockX, blockY, dx, dy);
+        break;
+      }
+      case COMMAND_FADE: {
+        // (the faded image is never written to VRAM)
+        setFade(command & FADE_LEVEL_BIT_MASK,
+                (command & FADE_WHITE_BIT_MASK) != 0);
+        break;
+      }
+      case COMMAND_FILL: {
+        fill(command & 0xff);
+        break;
+      }
+      case COMMAND_STORE_REFERENCE: {
+        storeReference((command & 0xff) % REFERENCE_SLOTS);
+        break;
+      }
+      case COMMAND_RESTORE_BLOCK: {
+        u32 blockX = command & 0b11111;
+        u32 blockY = (command >> 5) & 0b11111;
+        u32 slot = ((command >> 10) & 0b1) % REFERENCE_SLOTS;
+        restoreBlock(slot, blockX, blockY);
+        break;
+      }
+      case COMMAND_SET_PALETTE_COLOR: {
+        setPaletteColor((command >> PALETTE_INDEX_BIT_OFFSET) & 0xff,
+                        command & PALETTE_COLOR_BIT_MASK);
+        hasPaletteChanges = true;
+        break;
+      }
+      default:
+        break;
+    }
+  }
+
+  if (hasPaletteChanges)
+    uploadPalette();
+}
+
+ALWAYS_INLINE void runAfterRender() {
+  // (render mode changes affect the next frame, which will be a full one)
+  for (u32 i = 0; i < state.commandPackets; i++) {
+    u32 command = commands[i];
+
+    switch (command >> COMMAND_ID_BIT_OFFSET) {
+      case COMMAND_SET_RENDER_MODE: {
+        u32 renderMode = command & 0xff;
+        if (renderMode < RENDER_MODES && !RENDER_MODE_IS_INVALID(renderMode))
+          setRenderMode(renderMode);
+        break;
+      }
+      default:
+        break;
+    }
+  }
+}
+
+}  // namespace FrameCommands
+
+#endif  // FRAME_COMMANDS_H
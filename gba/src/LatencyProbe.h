@@ -0,0 +1,95 @@
+#ifndef LATENCY_PROBE_H
+#define LATENCY_PROBE_H
+
+#include <tonc.h>
+
+#include "BuildConfig.h"
+#include "Protocol.h"
+#include "Utils.h"
+
+// Timestamps for the RPI's latency measurements (WITH_LATENCY_PROBE).
+// Timer 2 counts 64-cycle ticks. A keypad interrupt stamps key presses, and
+// every frame the GBA reports how long the last press took to be transferred
+// and how long the last frame took to render.
+
+namespace LatencyProbe {
+
+#ifdef WITH_LATENCY_PROBE
+u16 pressTime = 0;
+bool hasPress = false;
+u32 inputTicks = LATENCY_NONE;
+u16 frameEndTime = 0;
+u32 renderTicks = LATENCY_NONE;
+
+ALWAYS_INLINE u16 now() {
+  return REG_TM2CNT_L;
+}
+
+ALWAYS_INLINE void arm(u16 keys) {
+  // (only released keys can interrupt, so held keys don't fire again)
+  REG_KEYCNT = (KEY_ANY & ~keys) | KCNT_IRQ | KCNT_OR;
+}
+
+CODE_IWRAM void onKeyPress() {
+  pressTime = now();
+  hasPress = true;
+  REG_KEYCNT = 0;
+}
+#endif
+
+ALWAYS_INLINE void init() {
+#ifdef WITH_LATENCY_PROBE
+  REG_TM2CNT_H = 0;
+  REG_TM2CNT_L = 0;
+  REG_TM2CNT_H = TM_ENABLE | TM_FREQ_64;
+  irq_init(NULL);
+  irq_add(II_KEYPAD, onKeyPress);
+  arm(pressedKeys());
+#endif
+}
+
+ALWAYS_INLINE void onKeys(u16 previousKeys, u16 keys) {
+#ifdef WITH_LATENCY_PROBE
+  if (hasPress && (keys & ~previousKeys) != 0) {
+    inputTicks = min((u32)(u16)(now() - pressTime), (u32)LATENCY_NONE - 1);
+    hasPress = false;
+  }
+  arm(keys);
+#endif
+}
+
+ALWAYS_INLINE void forgetMissedPress(u16 keys) {
+  // (a press that was released before any transfer saw it is not reported)
+#ifdef WITH_LATENCY_PROBE
+  if (hasPress) {
+    hasPress = false;
+    arm(keys);
+  }
+#endif
+}
+
+ALWAYS_INLINE void onFrameEnd() {
+#ifdef WITH_LATENCY_PROBE
+  frameEndTime = now();
+#endif
+}
+
+ALWAYS_INLINE void onRendered() {
+#ifdef WITH_LATENCY_PROBE
+  renderTicks = min((u32)(u16)(now() - frameEndTime), (u32)LATENCY_NONE - 1);
+#endif
+}
+
+ALWAYS_INLINE u32 report() {
+#ifdef WITH_LATENCY_PROBE
+  u32 report = inputTicks | (renderTicks << LATENCY_RENDER_BIT_OFFSET);
+  inputTicks = LATENCY_NONE;
+  return report;
+#else
+  return LATENCY_NONE | (LATENCY_NONE << LATENCY_RENDER_BIT_OFFSET);
+#endif
+}
+
+}  // namespace LatencyProbe
+
+#endif  // LATENCY_PROBE_H
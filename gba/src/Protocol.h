@@ -24,12 +24,22 @@
 #define AUDIO_PADDED_SIZE (AUDIO_CHUNK_SIZE + AUDIO_CHUNK_PADDING)
 
 // DIFFS
-#define TEMPORAL_DIFF_MAX_SIZE(TOTAL_PIXELS) (TOTAL_PIXELS / 8)
+// (sizes round up: a field of mode 0 has 1200 pixels => 150 bytes, 38 packets)
+#define TEMPORAL_DIFF_MAX_SIZE(TOTAL_PIXELS) ((TOTAL_PIXELS + 7) / 8)
 #define TEMPORAL_DIFF_MAX_PADDED_SIZE(TOTAL_PIXELS) \
   (TEMPORAL_DIFF_MAX_SIZE(TOTAL_PIXELS) + 4)
 #define TEMPORAL_DIFF_MAX_PACKETS(TOTAL_PIXELS) \
-  (TEMPORAL_DIFF_MAX_SIZE(TOTAL_PIXELS) / PACKET_SIZE)
+  ((TEMPORAL_DIFF_MAX_SIZE(TOTAL_PIXELS) + PACKET_SIZE - 1) / PACKET_SIZE)
 #define MAX_RLE 255
+#define PACKED_MAX_RLE 16
+#define PACKED_PALETTE_COLORS 16
+
+// SCAN ORDERS
+#define SCAN_ORDERS 3
+#define SCAN_ORDER_ROWS 0
+#define SCAN_ORDER_COLUMNS 1
+#define SCAN_ORDER_BLOCKS 2
+#define SCAN_BLOCK_SIZE 4  // (every frame size is a multiple of 4, not 8)
 
 // FILES
 #define CONFIG_FILENAME "config.cfg"
@@ -44,6 +54,7 @@
 #define CMD_AUDIO 0x12345620
 #define CMD_PIXELS 0x12345630
 #define CMD_FRAME_END 0x12345640
+#define CMD_COMMANDS 0x12345650
 #define CMD_RECOVERY 0x98765490
 
 // RESET PACKET
@@ -64,12 +75,76 @@
 #define START_BIT_MASK 0b00000000000000001111111111111111
 #define PACKS_BIT_OFFSET 16
 
+// DIFF END PACKET
+#define DIFF_END_BIT_MASK 0b00000000000000001111111111111111
+#define INTERLACE_BIT_MASK 0b00000100000000000000000000000000
+#define FIELD_BIT_MASK 0b00001000000000000000000000000000
+#define PACKED_BIT_MASK 0b00010000000000000000000000000000
+#define SCAN_ORDER_BIT_MASK 0b11
+#define SCAN_ORDER_BIT_OFFSET 29
+#define COMMANDS_BIT_MASK 0b1111111111
+#define COMMANDS_BIT_OFFSET 16
+
+// STREAM REPLY PACKET (what the GBA sends back for every stream packet)
+#define REPLY_INDEX_BIT_MASK 0b11111111111111
+#define REPLY_KEYS_BIT_MASK 0b1111111111
+#define REPLY_KEYS_BIT_OFFSET 14
+#define REPLY_SEQUENCE_BIT_MASK 0b1111
+#define REPLY_SEQUENCE_BIT_OFFSET 24
+#define REPLY_MARKER 0b0101
+#define REPLY_MARKER_BIT_OFFSET 28
+#define STREAM_REPLY(INDEX, KEYS, SEQUENCE)      \
+  ((INDEX) | ((KEYS) << REPLY_KEYS_BIT_OFFSET) | \
+   ((SEQUENCE) << REPLY_SEQUENCE_BIT_OFFSET) |   \
+   ((uint32_t)REPLY_MARKER << REPLY_MARKER_BIT_OFFSET))
+#define IS_STREAM_REPLY(VALUE) \
+  (((VALUE) >> REPLY_MARKER_BIT_OFFSET) == REPLY_MARKER)
+
+// LATENCY REPORT (GBA's answer to the diff end packet, with WITH_LATENCY_PROBE)
+#define LATENCY_INPUT_BIT_MASK 0xffff  // (key press => first transfer with it)
+#define LATENCY_RENDER_BIT_OFFSET 16   // (frame end => rendered, last frame)
+#define LATENCY_NONE 0xffff
+#define LATENCY_TICK_NS 3815  // (64 cycles at 16.78Mhz)
+
+// FRAME COMMANDS
+#define COMMANDS_MAX_PACKETS 512
+#define COMMAND_ID_BIT_OFFSET 24
+#define COMMAND_SCROLL 1
+#define COMMAND_COPY_BLOCK 2
+#define COMMAND_FADE 3
+#define COMMAND_FILL 4
+#define COMMAND_STORE_REFERENCE 5
+#define COMMAND_RESTORE_BLOCK 6
+#define COMMAND_SET_RENDER_MODE 7
+#define COMMAND_SET_PALETTE_COLOR 8
+#define SCROLL_MAX_DISTANCE 8
+#define BLOCK_SIZE 8
+#define BLOCK_MAX_DISTANCE 8
+#define FADE_MAX_LEVEL 16
+#define FADE_LEVEL_BIT_MASK 0b11111
+#define FADE_WHITE_BIT_MASK 0b100000
+#define REFERENCE_SLOTS 2
+#define PALETTE_COLOR_BIT_MASK 0b111111111111111
+#define PALETTE_INDEX_BIT_OFFSET 16
+
+// TILES
+#define TILE_SIZE 8
+#define TILE_BYTES (TILE_SIZE * TILE_SIZE)
+#define TILE_MAP_WIDTH 32
+#define TILE_MAP_CELLS (TILE_MAP_WIDTH * (DRAW_HEIGHT / TILE_SIZE))
+#define TILE_MAP_SCREENBLOCK 31
+#define TILE_SLOTS 992  // (the map uses the last 2KB of background VRAM)
+#define TILE_NEW_BIT_MASK 0b1000000000000000
+#define TILE_SLOT_BIT_MASK 0b0000001111111111
+
 // RENDER MODES
 #define RENDER_MODES 9
 #define RENDER_MODE_BENCHMARK_1 9
 #define RENDER_MODE_BENCHMARK_2 10
 #define RENDER_MODE_IS_BENCHMARK(MODE) \
   (MODE == RENDER_MODE_BENCHMARK_1 || MODE == RENDER_MODE_BENCHMARK_2)
+#define RENDER_MODE_TILES 11
+#define TILE_MODE_RENDER_MODE 8
 #define DEFAULT_RENDER_MODE 4
 #define COMPRESSION_LEVELS 6
 
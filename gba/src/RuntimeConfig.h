@@ -6,7 +6,7 @@
 #include "Utils.h"
 #include "_state.h"
 
-#define CONFIG_ITEMS 11
+#define CONFIG_ITEMS 12
 #define CONFIG_PERCENTAGE_ITEMS 3
 #define CONFIG_BOOLEAN_ITEMS 2
 #define CONFIG_NUMERIC_ITEMS 9
@@ -30,6 +30,9 @@ typedef struct Config {
   u8 frameWidthIndex;
   u8 frameHeightIndex;
   bool scanlines;
+  bool tileMode;
+  u8 previousWidthIndex;  // (restored when tile mode is turned off)
+  u8 previousHeightIndex;
   u8 compression;
   bool cpuOverclock;
   bool ewramOverclock;
@@ -37,8 +40,10 @@ typedef struct Config {
   u8 controls;
 
   bool isBenchmark() { return RENDER_MODE_IS_BENCHMARK(renderMode); }
+  u32 wireRenderMode() { return tileMode ? RENDER_MODE_TILES : renderMode; }
   void update() {
     renderMode = frameWidthIndex * CONFIG_PERCENTAGE_ITEMS + frameHeightIndex;
+    tileMode = tileMode && renderMode == TILE_MODE_RENDER_MODE;
   }
 } Config;
 
@@ -50,6 +55,7 @@ enum Option {
   FRAME_WIDTH,
   FRAME_HEIGHT,
   SCANLINES,
+  TILE_MODE,
   COMPRESSION,
   CPU_OVERCLOCK,
   EWRAM_OVERCLOCK,
@@ -78,6 +84,10 @@ inline void drawMenu(u32 option) {
   tte_write("Scanlines              ");
   tte_write(CONFIG_BOOLEAN_OPTIONS[config.scanlines]);
   tte_write("\n");
+  tte_write(SELECTION(Option::TILE_MODE));
+  tte_write("Tile mode              ");
+  tte_write(CONFIG_BOOLEAN_OPTIONS[config.tileMode]);
+  tte_write("\n");
   tte_write(SELECTION(Option::COMPRESSION));
   tte_write("Compression             ");
   tte_write(CONFIG_COMPRESSION_OPTIONS[config.compression]);
@@ -112,6 +122,9 @@ ALWAYS_INLINE void initialize() {
   config.frameWidthIndex = 1;
   config.frameHeightIndex = 1;
   config.scanlines = true;
+  config.tileMode = false;
+  config.previousWidthIndex = config.frameWidthIndex;
+  config.previousHeightIndex = config.frameHeightIndex;
   config.compression = 2;
   config.cpuOverclock = false;
   config.exitWithStart = false;
@@ -162,6 +175,21 @@ ALWAYS_INLINE void show() {
           config.scanlines = !config.scanlines;
           break;
         }
+        case Option::TILE_MODE: {
+          // (tiles are only streamed at full resolution)
+          config.tileMode = !config.tileMode;
+          if (config.tileMode) {
+            config.previousWidthIndex = config.frameWidthIndex;
+            config.previousHeightIndex = config.frameHeightIndex;
+            config.frameWidthIndex = CONFIG_PERCENTAGE_ITEMS - 1;
+            config.frameHeightIndex = CONFIG_PERCENTAGE_ITEMS - 1;
+          } else {
+            config.frameWidthIndex = config.previousWidthIndex;
+            config.frameHeightIndex = config.previousHeightIndex;
+          }
+          config.update();
+          break;
+        }
         case Option::COMPRESSION: {
           config.compression = CYCLE_OPTIONS(config.compression + direction,
                                              CONFIG_COMPRESSION_ITEMS);
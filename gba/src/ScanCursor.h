@@ -0,0 +1,67 @@
+#ifndef SCAN_CURSOR_H
+#define SCAN_CURSOR_H
+
+#include <tonc.h>
+
+#include "Protocol.h"
+#include "Utils.h"
+
+#define SCAN_BLOCK_PIXELS (SCAN_BLOCK_SIZE * SCAN_BLOCK_SIZE)
+
+typedef struct {
+  // (tracks the screen position of a column-major or block-major cursor
+  //  without divisions: the cursor only moves forward, so the position is
+  //  advanced with a few subtractions)
+  u32 order;
+  u32 cursor;
+  u32 minor;
+  u32 major;
+  u32 blockX;
+  u32 blockY;
+  u32 minorSize;
+  u32 blocksPerRow;
+  u32 scaleX;
+  u32 rowStride;
+  u32 firstRow;
+
+  ALWAYS_INLINE void initialize(u32 order,
+                                u32 width,
+                                u32 height,
+                                u32 scaleX,
+                                u32 rowStride,
+                                u32 firstRow) {
+    this->order = order;
+    cursor = minor = major = blockX = blockY = 0;
+    minorSize = order == SCAN_ORDER_COLUMNS ? height : SCAN_BLOCK_PIXELS;
+    blocksPerRow = width / SCAN_BLOCK_SIZE;
+    this->scaleX = scaleX;
+    this->rowStride = rowStride;
+    this->firstRow = firstRow;
+  }
+
+  ALWAYS_INLINE u32 offsetOf(u32 target) {
+    minor += target - cursor;
+    cursor = target;
+    while (minor >= minorSize) {
+      minor -= minorSize;
+      major++;
+      if (order == SCAN_ORDER_BLOCKS && ++blockX == blocksPerRow) {
+        blockX = 0;
+        blockY++;
+      }
+    }
+
+    u32 x, y;
+    if (order == SCAN_ORDER_COLUMNS) {
+      x = major;
+      y = minor;
+    } else {
+      x = blockX * SCAN_BLOCK_SIZE + minor % SCAN_BLOCK_SIZE;
+      y = blockY * SCAN_BLOCK_SIZE + minor / SCAN_BLOCK_SIZE;
+    }
+
+    return (y * rowStride + firstRow) * DRAW_WIDTH + x * scaleX;
+  }
+} ScanCursor;
+
+#endif  // SCAN_CURSOR_H
@@ -3,6 +3,8 @@
 
 #include <tonc.h>
 
+#include "Protocol.h"
+
 #define CODE_IWRAM __attribute__((section(".iwram"), target("arm")))
 #define CODE_EWRAM __attribute__((section(".ewram"), long_call))
 #define DATA_IWRAM __attribute__((section(".iwram")))
@@ -17,6 +19,22 @@ ALWAYS_INLINE void enableMode4AndBackground2() {
   REG_DISPCNT = DCNT_MODE4 | DCNT_BG2;
 }
 
+ALWAYS_INLINE void enableMode0AndBackground0() {
+  REG_DISPCNT = DCNT_MODE0 | DCNT_BG0;
+  REG_BG0CNT =
+      BG_CBB(0) | BG_SBB(TILE_MAP_SCREENBLOCK) | BG_8BPP | BG_REG_32x32;
+}
+
+ALWAYS_INLINE void clearTileMap(u32 screenBlock) {
+  memset32(se_mem[screenBlock], 0, sizeof(SCREENBLOCK) / 4);
+}
+
+ALWAYS_INLINE void setFade(u32 level, bool isWhite) {
+  REG_BLDCNT = level > 0 ? BLD_BG0 | BLD_BG2 | (isWhite ? BLD_WHITE : BLD_BLACK)
+                         : BLD_OFF;
+  REG_BLDY = BLDY_BUILD(level);
+}
+
 ALWAYS_INLINE void overclockEWRAM() {
   *((u32*)0x4000800) = (0x0E << 24) | (1 << 5);
 }
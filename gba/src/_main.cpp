@@ -2,10 +2,13 @@
 
 #include "Benchmark.h"
 #include "BuildConfig.h"
+#include "FrameCommands.h"
+#include "LatencyProbe.h"
 #include "Palette.h"
 #include "Protocol.h"
 #include "RuntimeConfig.h"
 #include "SPISlave.h"
+#include "ScanCursor.h"
 #include "Utils.h"
 #include "_state.h"
 
@@ -27,14 +30,24 @@ void mainLoop();
 void syncReset();
 bool sendKeysAndReceiveMetadata();
 bool receiveAudio();
+bool receiveCommands();
 bool receivePixels();
-void render(bool withRLE, u32 width, u32 scaleX, u32 scaleY, u32 totalPixels);
+void render(bool withRLE,
+            u32 scanOrder,
+            u32 width,
+            u32 scaleX,
+            u32 scaleY,
+            u32 totalPixels);
+void renderTiles();
 bool needsToRunAudio();
 void runAudio();
+u16 readKeys();
+u32 streamReply(u32 index);
 u32 transfer(u32 packetToSend, bool withRecovery = true);
 bool sync(u32 command);
 u32 x(u32 cursor, u32 width, u32 scaleX);
 u32 y(u32 cursor, u32 width, u32 scaleY);
+void unpackPixels();
 void optimizedRender();
 
 SPISlave* spiSlave = new SPISlave();
@@ -58,6 +71,8 @@ CODE_EWRAM int main() {
 
     init();
     mainLoop();
+    setFade(0, false);
+    FrameCommands::resetPalette();
 
 #ifdef WITH_AUDIO
     player_stop();
@@ -75,10 +90,15 @@ ALWAYS_INLINE void wipeScreen() {
 }
 
 ALWAYS_INLINE void init() {
-  enableMode4AndBackground2();
-  setMosaic(RENDER_MODE_SCALEX[config.renderMode],
-            config.scanlines ? 1 : RENDER_MODE_SCALEY[config.renderMode]);
+  if (config.tileMode) {
+    enableMode0AndBackground0();
+    memset32(tile_mem, 0, TILE_BYTES / 4);  // (blank tile)
+  } else {
+    enableMode4AndBackground2();
+    FrameCommands::setRenderMode(config.renderMode);
+  }
   dma3_cpy(pal_bg_mem, MAIN_PALETTE, sizeof(COLOR) * PALETTE_COLORS);
+  LatencyProbe::init();
 #ifdef WITH_AUDIO
   player_init();
 #endif
@@ -88,13 +108,22 @@ CODE_IWRAM void mainLoop() {
   state.hasAudio = false;
   state.isVBlank = false;
   state.isAudioReady = false;
+  state.replyKeys = 0;
+  state.replySequence = 0;
+  u32 renderMode = config.renderMode;
 
 reset:
+  // (the RPI can change the render mode, but it's restored on resets)
+  if (config.renderMode != renderMode)
+    FrameCommands::setRenderMode(renderMode);
   syncReset();
 
   while (true) {
-    if ((config.exitWithStart && needsRestartSTART()) || needsRestartABLR())
+    if ((config.exitWithStart && needsRestartSTART()) || needsRestartABLR()) {
+      // (the menu has to show the mode it picked, not the RPI's one)
+      config.renderMode = renderMode;
       return;
+    }
 
     TRY(sync(CMD_FRAME_START))
     TRY(sendKeysAndReceiveMetadata())
@@ -102,41 +131,79 @@ reset:
       TRY(sync(CMD_AUDIO))
       TRY(receiveAudio())
     }
+    if (state.commandPackets > 0) {
+      TRY(sync(CMD_COMMANDS))
+      TRY(receiveCommands())
+    }
     TRY(sync(CMD_PIXELS))
     TRY(receivePixels())
     TRY(sync(CMD_FRAME_END))
+    LatencyProbe::onFrameEnd();
 
+    FrameCommands::run();
     optimizedRender();
+    LatencyProbe::onRendered();
+    FrameCommands::runAfterRender();
   }
 }
 
 ALWAYS_INLINE void syncReset() {
   u32 resetPacket =
-      CMD_RESET + (config.renderMode |
+      CMD_RESET + (config.wireRenderMode() |
                    (config.controls << CONTROLS_BIT_OFFSET) |
                    (config.compression << COMPRESSION_BIT_OFFSET) |
                    (config.cpuOverclock << CPU_OVERCLOCK_BIT_OFFSET));
   while (transfer(resetPacket, false) != resetPacket)
     ;
+
+  setFade(0, false);
+  FrameCommands::resetPalette();
+
+  if (config.tileMode) {
+    // (the RPI forgets its tile cache on resets)
+    clearTileMap(TILE_MAP_SCREENBLOCK);
+  }
 }
 
 ALWAYS_INLINE bool sendKeysAndReceiveMetadata() {
-  u16 keys = pressedKeys();
+  u16 keys = readKeys();
   u32 metadata = spiSlave->transfer(keys);
   if (spiSlave->transfer(metadata) != keys)
     return false;
 
-  state.expectedPackets = (metadata >> PACKS_BIT_OFFSET) & PACKS_BIT_MASK;
+  state.expectedPackets =
+      min((metadata >> PACKS_BIT_OFFSET) & PACKS_BIT_MASK,
+          (u32)MAX_PIXELS_SIZE);
   state.startPixel = metadata & START_BIT_MASK;
   state.isRLE = (metadata & COMPR_BIT_MASK) != 0;
   state.hasAudio = (metadata & AUDIO_BIT_MASK) != 0;
 
-  u32 diffMaxPackets =
-      TEMPORAL_DIFF_MAX_PACKETS(RENDER_MODE_PIXELS[config.renderMode]);
   u32 diffStart = (state.startPixel / 8) / PACKET_SIZE;
-  u32 diffEndPacket = min(spiSlave->transfer(0), diffMaxPackets);
+  u32 diffEndPacketAndCommands = spiSlave->transfer(LatencyProbe::report());
+  LatencyProbe::forgetMissedPress(keys);
+  state.isInterlaced = !config.tileMode &&
+                       (diffEndPacketAndCommands & INTERLACE_BIT_MASK) != 0;
+  state.field = (diffEndPacketAndCommands & FIELD_BIT_MASK) != 0;
+  state.isPacked = !config.tileMode &&
+                   (diffEndPacketAndCommands & PACKED_BIT_MASK) != 0;
+  state.scanOrder =
+      (diffEndPacketAndCommands >> SCAN_ORDER_BIT_OFFSET) & SCAN_ORDER_BIT_MASK;
+  if (config.tileMode || state.scanOrder >= SCAN_ORDERS)
+    state.scanOrder = SCAN_ORDER_ROWS;
+  if (state.isPacked)
+    state.expectedPackets =
+        min(state.expectedPackets, (u32)MAX_PIXELS_SIZE / 2);
+  u32 diffMaxPackets = TEMPORAL_DIFF_MAX_PACKETS(
+      config.tileMode ? TILE_MAP_CELLS
+                      : RENDER_MODE_PIXELS[config.renderMode] /
+                            (state.isInterlaced ? 2 : 1));
+  u32 diffEndPacket =
+      min(diffEndPacketAndCommands & DIFF_END_BIT_MASK, diffMaxPackets);
+  state.commandPackets =
+      min((diffEndPacketAndCommands >> COMMANDS_BIT_OFFSET) & COMMANDS_BIT_MASK,
+          (u32)COMMANDS_MAX_PACKETS);
   for (u32 i = diffStart; i < diffEndPacket; i++)
-    ((u32*)state.temporalDiffs)[i] = transfer(i);
+    ((u32*)state.temporalDiffs)[i] = transfer(streamReply(i));
   for (u32 i = diffEndPacket; i < diffMaxPackets; i++)
     ((u32*)state.temporalDiffs)[i] = 0;
 
@@ -145,21 +212,29 @@ ALWAYS_INLINE bool sendKeysAndReceiveMetadata() {
 
 ALWAYS_INLINE bool receiveAudio() {
   for (u32 i = 0; i < AUDIO_SIZE_PACKETS; i++)
-    ((u32*)state.audioChunks)[i] = transfer(i);
+    ((u32*)state.audioChunks)[i] = transfer(streamReply(i));
 
   state.isAudioReady = true;
 
   return true;
 }
 
+ALWAYS_INLINE bool receiveCommands() {
+  for (u32 i = 0; i < state.commandPackets; i++)
+    commands[i] = transfer(streamReply(i));
+
+  return true;
+}
+
 ALWAYS_INLINE bool receivePixels() {
   for (u32 i = 0; i < state.expectedPackets; i++)
-    ((u32*)compressedPixels)[i] = transfer(i);
+    ((u32*)compressedPixels)[i] = transfer(streamReply(i));
 
   return true;
 }
 
 ALWAYS_INLINE void render(bool withRLE,
+                          u32 scanOrder,
                           u32 width,
                           u32 scaleX,
                           u32 scaleY,
@@ -168,6 +243,21 @@ ALWAYS_INLINE void render(bool withRLE,
   u32 rleRepeats = compressedPixels[0];
   u32 decompressedBytes = withRLE;
 
+  // (interlaced frames only contain the rows of one field)
+  u32 rowStride = scaleY;
+  u32 firstRow = 0;
+  if (state.isInterlaced) {
+    rowStride = scaleY * 2;
+    firstRow = state.field * scaleY;
+    totalPixels /= 2;
+  }
+
+  // (other scan orders are only specialized per order, not per render mode)
+  ScanCursor scanCursor;
+  if (scanOrder != SCAN_ORDER_ROWS)
+    scanCursor.initialize(scanOrder, width, totalPixels / width, scaleX,
+                          rowStride, firstRow);
+
 #define RUN_AUDIO_IF_NEEDED()               \
   if (withRLE) {                            \
     if (needsToRunAudio())                  \
@@ -176,8 +266,11 @@ ALWAYS_INLINE void render(bool withRLE,
     if (!(cursor % 8) && needsToRunAudio()) \
       runAudio();                           \
   }
-#define DRAW_PIXEL(PIXEL)                                                  \
-  m4Draw(y(cursor, width, scaleY) * DRAW_WIDTH + x(cursor, width, scaleX), \
+#define DRAW_PIXEL(PIXEL)                                              \
+  m4Draw(scanOrder == SCAN_ORDER_ROWS                                  \
+             ? (y(cursor, width, rowStride) + firstRow) * DRAW_WIDTH + \
+                   x(cursor, width, scaleX)                            \
+             : scanCursor.offsetOf(cursor),                            \
          PIXEL);
 #define DRAW_NEXT()                                         \
   if (withRLE) {                                            \
@@ -245,6 +338,28 @@ ALWAYS_INLINE void render(bool withRLE,
   }
 }
 
+ALWAYS_INLINE void renderTiles() {
+  u16* payload = (u16*)compressedPixels;
+  u16* map = (u16*)se_mem[TILE_MAP_SCREENBLOCK];
+
+  for (u32 cell = state.startPixel; cell < TILE_MAP_CELLS; cell++) {
+    if (needsToRunAudio())
+      runAudio();
+
+    if (!BIT_IS_HIGH(state.temporalDiffs[cell / 8], cell % 8))
+      continue;
+
+    u16 entry = *(payload++);
+    u32 slot = entry & TILE_SLOT_BIT_MASK;
+    if (entry & TILE_NEW_BIT_MASK) {
+      // (tile data comes after a 2-byte entry, so it's only halfword-aligned)
+      memcpy16((u8*)tile_mem + slot * TILE_BYTES, payload, TILE_BYTES / 2);
+      payload += TILE_BYTES / 2;
+    }
+    map[cell] = slot;
+  }
+}
+
 ALWAYS_INLINE bool needsToRunAudio() {
 #ifndef WITH_AUDIO
   return false;
@@ -270,6 +385,25 @@ CODE_IWRAM void runAudio() {
   spiSlave->start();
 }
 
+ALWAYS_INLINE u16 readKeys() {
+  // (the sequence number changes when the keys do)
+  u16 keys = pressedKeys();
+  if (keys != state.replyKeys) {
+    LatencyProbe::onKeys(state.replyKeys, keys);
+    state.replyKeys = keys;
+    state.replySequence = (state.replySequence + 1) & REPLY_SEQUENCE_BIT_MASK;
+  }
+
+  return keys;
+}
+
+ALWAYS_INLINE u32 streamReply(u32 index) {
+  // (every reply carries the current keys, so the RPI can apply them before
+  //  the frame ends)
+  u32 keys = readKeys();
+  return STREAM_REPLY(index, keys, state.replySequence);
+}
+
 ALWAYS_INLINE u32 transfer(u32 packetToSend, bool withRecovery) {
   bool breakFlag = false;
   u32 receivedPacket =
@@ -324,10 +458,45 @@ ALWAYS_INLINE u32 y(u32 cursor, u32 width, u32 scaleY) {
   return (cursor / width) * scaleY;
 }
 
+ALWAYS_INLINE void unpackPixels() {
+  // (4bpp payloads are expanded in place, from the end, so unread bytes are
+  //  never overwritten; RLE runs are stored as (length - 1) << 4 | color)
+  u16* input = (u16*)compressedPixels;
+  u32* output = (u32*)compressedPixels;
+
+  for (s32 i = state.expectedPackets * 2 - 1; i >= 0; i--) {
+    if (!(i % 8) && needsToRunAudio())
+      runAudio();
+
+    u32 packed = input[i];
+    output[i] = state.isRLE ? (((packed >> 4) & 0xf) + 1) |
+                                  ((packed & 0xf) << 8) |
+                                  ((((packed >> 12) & 0xf) + 1) << 16) |
+                                  (((packed >> 8) & 0xf) << 24)
+                            : (packed & 0xf) | ((packed & 0xf0) << 4) |
+                                  ((packed & 0xf00) << 8) |
+                                  ((packed & 0xf000) << 12);
+  }
+}
+
 ALWAYS_INLINE void optimizedRender() {
-#define RENDER(N, WITH_RLE)                                     \
-  render(WITH_RLE, RENDER_MODE_WIDTH[N], RENDER_MODE_SCALEX[N], \
-         RENDER_MODE_SCALEY[N], RENDER_MODE_PIXELS[N]);
+#define RENDER(N, WITH_RLE)                                  \
+  render(WITH_RLE, SCAN_ORDER_ROWS, RENDER_MODE_WIDTH[N],    \
+         RENDER_MODE_SCALEX[N], RENDER_MODE_SCALEY[N],       \
+         RENDER_MODE_PIXELS[N]);
+#define RENDER_IN_ORDER(ORDER, WITH_RLE)                        \
+  render(WITH_RLE, ORDER, RENDER_MODE_WIDTH[config.renderMode], \
+         RENDER_MODE_SCALEX[config.renderMode],                 \
+         RENDER_MODE_SCALEY[config.renderMode],                 \
+         RENDER_MODE_PIXELS[config.renderMode]);
+#define HANDLE_SCAN_ORDER(ORDER)     \
+  case ORDER: {                      \
+    if (state.isRLE)                 \
+      RENDER_IN_ORDER(ORDER, true)   \
+    else                             \
+      RENDER_IN_ORDER(ORDER, false)  \
+    return;                          \
+  }
 #define HANDLE_RENDER_MODE(N)         \
   case N: {                           \
     if (!RENDER_MODE_IS_INVALID(N)) { \
@@ -339,6 +508,20 @@ ALWAYS_INLINE void optimizedRender() {
     break;                            \
   }
 
+  if (config.tileMode) {
+    renderTiles();
+    return;
+  }
+  if (state.isPacked)
+    unpackPixels();
+
+  switch (state.scanOrder) {
+    HANDLE_SCAN_ORDER(SCAN_ORDER_COLUMNS)
+    HANDLE_SCAN_ORDER(SCAN_ORDER_BLOCKS)
+    default:
+      break;
+  }
+
   // (this creates multiple copies of render(...)'s code)
   switch (config.renderMode) {
     HANDLE_RENDER_MODE(0)
@@ -4,4 +4,7 @@
 
 DATA_IWRAM State state;
 DATA_IWRAM Config config;
-DATA_EWRAM u8 compressedPixels[MAX_PIXELS_SIZE];
+DATA_EWRAM u8 compressedPixels[TOTAL_SCREEN_PIXELS];
+DATA_EWRAM u32 commands[COMMANDS_MAX_PACKETS];
+DATA_EWRAM u32 references[REFERENCE_SLOTS][TOTAL_SCREEN_PIXELS / 4];
+DATA_EWRAM u32 palette[PALETTE_COLORS / 2];
@@ -10,13 +10,23 @@ typedef struct {
   u8 audioChunks[AUDIO_PADDED_SIZE];
   u32 expectedPackets;
   u32 startPixel;
+  u32 commandPackets;
+  u32 field;
+  u32 scanOrder;
+  u32 replyKeys;
+  u32 replySequence;
   bool isRLE;
   bool hasAudio;
+  bool isInterlaced;
+  bool isPacked;
   bool isVBlank;
   bool isAudioReady;
 } State;
 
 extern State state;
-extern u8 compressedPixels[MAX_PIXELS_SIZE];
+extern u8 compressedPixels[TOTAL_SCREEN_PIXELS];
+extern u32 commands[COMMANDS_MAX_PACKETS];
+extern u32 references[REFERENCE_SLOTS][TOTAL_SCREEN_PIXELS / 4];
+extern u32 palette[PALETTE_COLORS / 2];
 
 #endif  // STATE_H
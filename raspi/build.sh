@@ -14,6 +14,8 @@ g++ \
   -L./lib \
   -L/opt/vc/lib \
   -lbcm_host \
+  -lrt \
+  -lpthread \
   ./lib/code/** \
   ./src/** \
   ./lib/libbcm2835.a \
@@ -0,0 +1,257 @@
+#ifndef AREA_DOWNSCALER_H
+#define AREA_DOWNSCALER_H
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+#define LETTERBOX_CHECK_FRAMES 30
+#define LETTERBOX_BLACK_LEVEL 24
+#define LETTERBOX_SAMPLE_STEP 4
+#define LETTERBOX_MAX_DIVISOR 4  // (bars can't cover more than 1/4 per side)
+
+typedef struct {
+  uint32_t left;
+  uint32_t top;
+  uint32_t right;  // (exclusive)
+  uint32_t bottom;  // (exclusive)
+} SourceArea;
+
+typedef struct {
+  uint32_t redOffset;
+  uint32_t greenOffset;
+  uint32_t blueOffset;
+} SourceFormat;
+
+class AreaDownscaler {
+ public:
+  AreaDownscaler(uint32_t sourceWidth,
+                 uint32_t sourceHeight,
+                 SourceFormat format,
+                 uint32_t cropLeft,
+                 uint32_t cropTop,
+                 uint32_t cropRight,
+                 uint32_t cropBottom,
+                 bool removeLetterbox) {
+    this->sourceWidth = sourceWidth;
+    this->sourceHeight = sourceHeight;
+    this->format = format;
+    this->removeLetterbox = removeLetterbox;
+
+    if (cropLeft + cropRight >= sourceWidth ||
+        cropTop + cropBottom >= sourceHeight) {
+      std::cout << "Error (Image): the crop is bigger than the frame buffer\n";
+      exit(25);
+    }
+
+    croppedArea = SourceArea{cropLeft, cropTop, sourceWidth - cropRight,
+                             sourceHeight - cropBottom};
+    area = lastDetectedArea = croppedArea;
+    framesSinceCheck = 0;
+    outputWidth = outputHeight = 0;
+
+    redSums.resize(sourceWidth);
+    greenSums.resize(sourceWidth);
+    blueSums.resize(sourceWidth);
+  }
+
+  template <typename F, typename G>
+  inline void downscale(uint8_t* buffer,
+                        uint32_t pitch,
+                        std::vector<bool>& changedRows,
+                        uint32_t width,
+                        uint32_t height,
+                        F action,
+                        G keepRow) {
+    // (each output pixel is the average of the source pixels it covers, so
+    //  thin details don't pop in and out like with nearest sampling)
+    if (removeLetterbox && ++framesSinceCheck >= LETTERBOX_CHECK_FRAMES) {
+      framesSinceCheck = 0;
+      detectLetterbox(buffer, pitch);
+    }
+    bool canKeepRows = true;
+    if (width != outputWidth || height != outputHeight || spansChanged) {
+      createSpans(width, height);
+      spansChanged = false;
+      canKeepRows = false;
+    }
+
+    for (uint32_t y = 0; y < height; y++) {
+      uint32_t firstRow = rowSpans[y];
+      uint32_t lastRow = spanEnd(rowSpans, y);
+
+      // (if no source row of this span changed, `keepRow` can reuse the
+      //  previous output and skip decoding it)
+      if (canKeepRows &&
+          !hasAnyChange(changedRows, firstRow, lastRow) && keepRow(y))
+        continue;
+
+      accumulateRows(buffer, pitch, firstRow, lastRow);
+
+      for (uint32_t x = 0; x < width; x++) {
+        uint32_t firstColumn = columnSpans[x];
+        uint32_t lastColumn = spanEnd(columnSpans, x);
+        uint32_t r = 0, g = 0, b = 0;
+        for (uint32_t column = firstColumn; column < lastColumn; column++) {
+          r += redSums[column];
+          g += greenSums[column];
+          b += blueSums[column];
+        }
+
+        uint32_t count = (lastColumn - firstColumn) * (lastRow - firstRow);
+        action(x, y, r / count, g / count, b / count);
+      }
+    }
+  }
+
+ private:
+  uint32_t sourceWidth;
+  uint32_t sourceHeight;
+  SourceFormat format;
+  bool removeLetterbox;
+  SourceArea croppedArea;  // (from the config)
+  SourceArea area;  // (the cropped area, without letterbox bars)
+  SourceArea lastDetectedArea;
+  uint32_t framesSinceCheck;
+  uint32_t outputWidth;
+  uint32_t outputHeight;
+  bool spansChanged = false;
+  std::vector<uint32_t> columnSpans;  // (first source column of each pixel)
+  std::vector<uint32_t> rowSpans;  // (first source row of each pixel)
+  std::vector<uint32_t> redSums;
+  std::vector<uint32_t> greenSums;
+  std::vector<uint32_t> blueSums;
+
+  void accumulateRows(uint8_t* buffer,
+                      uint32_t pitch,
+                      uint32_t firstRow,
+                      uint32_t lastRow) {
+    // (plain loops over contiguous arrays, so the compiler vectorizes them)
+    uint32_t first = area.left, last = area.right;
+    uint32_t* r = redSums.data();
+    uint32_t* g = greenSums.data();
+    uint32_t* b = blueSums.data();
+    uint32_t redOffset = format.redOffset;
+    uint32_t greenOffset = format.greenOffset;
+    uint32_t blueOffset = format.blueOffset;
+
+    memset(r + first, 0, (last - first) * sizeof(uint32_t));
+    memset(g + first, 0, (last - first) * sizeof(uint32_t));
+    memset(b + first, 0, (last - first) * sizeof(uint32_t));
+
+    for (uint32_t row = firstRow; row < lastRow; row++) {
+      uint32_t* pixels = (uint32_t*)(buffer + row * pitch);
+      for (uint32_t column = first; column < last; column++) {
+        uint32_t pixel = pixels[column];
+        r[column] += (pixel >> redOffset) & 0xff;
+        g[column] += (pixel >> greenOffset) & 0xff;
+        b[column] += (pixel >> blueOffset) & 0xff;
+      }
+    }
+  }
+
+  bool hasAnyChange(std::vector<bool>& changedRows,
+                    uint32_t firstRow,
+                    uint32_t lastRow) {
+    for (uint32_t row = firstRow; row < lastRow; row++)
+      if (changedRows[row])
+        return true;
+
+    return false;
+  }
+
+  void createSpans(uint32_t width, uint32_t height) {
+    outputWidth = width;
+    outputHeight = height;
+    columnSpans.resize(width + 1);
+    rowSpans.resize(height + 1);
+    fillSpans(columnSpans, area.left, area.right, width);
+    fillSpans(rowSpans, area.top, area.bottom, height);
+  }
+
+  void fillSpans(std::vector<uint32_t>& spans,
+                 uint32_t first,
+                 uint32_t last,
+                 uint32_t size) {
+    for (uint32_t i = 0; i <= size; i++)
+      spans[i] = first + i * (last - first) / size;
+  }
+
+  uint32_t spanEnd(std::vector<uint32_t>& spans, uint32_t i) {
+    // (spans are never empty: smaller sources repeat pixels instead)
+    return std::max(spans[i + 1], spans[i] + 1);
+  }
+
+  void detectLetterbox(uint8_t* buffer, uint32_t pitch) {
+    // (bars are black rows/columns on both sides; only the thinnest side is
+    //  trusted, so dark scenes at one edge aren't cropped, and the area has
+    //  to be detected twice in a row before it's used)
+    uint32_t maxBarWidth =
+        (croppedArea.right - croppedArea.left) / LETTERBOX_MAX_DIVISOR;
+    uint32_t maxBarHeight =
+        (croppedArea.bottom - croppedArea.top) / LETTERBOX_MAX_DIVISOR;
+
+    uint32_t top = 0, bottom = 0, left = 0, right = 0;
+    while (top < maxBarHeight &&
+           isRowBlack(buffer, pitch, croppedArea.top + top))
+      top++;
+    while (bottom < maxBarHeight &&
+           isRowBlack(buffer, pitch, croppedArea.bottom - 1 - bottom))
+      bottom++;
+    while (left < maxBarWidth &&
+           isColumnBlack(buffer, pitch, croppedArea.left + left))
+      left++;
+    while (right < maxBarWidth &&
+           isColumnBlack(buffer, pitch, croppedArea.right - 1 - right))
+      right++;
+    if (top == maxBarHeight && left == maxBarWidth)
+      return;  // (a black screen says nothing about the bars)
+
+    uint32_t barHeight = std::min(top, bottom);
+    uint32_t barWidth = std::min(left, right);
+    SourceArea detectedArea = SourceArea{
+        croppedArea.left + barWidth, croppedArea.top + barHeight,
+        croppedArea.right - barWidth, croppedArea.bottom - barHeight};
+
+    if (isSameArea(detectedArea, lastDetectedArea) &&
+        !isSameArea(detectedArea, area)) {
+      area = detectedArea;
+      spansChanged = true;
+    }
+    lastDetectedArea = detectedArea;
+  }
+
+  bool isRowBlack(uint8_t* buffer, uint32_t pitch, uint32_t row) {
+    uint32_t* pixels = (uint32_t*)(buffer + row * pitch);
+    for (uint32_t column = croppedArea.left; column < croppedArea.right;
+         column += LETTERBOX_SAMPLE_STEP)
+      if (!isBlack(pixels[column]))
+        return false;
+
+    return true;
+  }
+
+  bool isColumnBlack(uint8_t* buffer, uint32_t pitch, uint32_t column) {
+    for (uint32_t row = croppedArea.top; row < croppedArea.bottom;
+         row += LETTERBOX_SAMPLE_STEP)
+      if (!isBlack(((uint32_t*)(buffer + row * pitch))[column]))
+        return false;
+
+    return true;
+  }
+
+  bool isBlack(uint32_t pixel) {
+    return ((pixel >> format.redOffset) & 0xff) <= LETTERBOX_BLACK_LEVEL &&
+           ((pixel >> format.greenOffset) & 0xff) <= LETTERBOX_BLACK_LEVEL &&
+           ((pixel >> format.blueOffset) & 0xff) <= LETTERBOX_BLACK_LEVEL;
+  }
+
+  bool isSameArea(SourceArea& area1, SourceArea& area2) {
+    return area1.left == area2.left && area1.top == area2.top &&
+           area1.right == area2.right && area1.bottom == area2.bottom;
+  }
+};
+
+#endif  // AREA_DOWNSCALER_H
@@ -2,12 +2,21 @@
 #define BENCHMARK_H
 
 #include <stdint.h>
+#include <stdlib.h>
 #include "BuildConfig.h"
 #include "Config.h"
+#include "Frame.h"
+#include "ImageDiffRLECompressor.h"
+#include "OrderedDither.h"
+#include "Palette.h"
 #include "Protocol.h"
 #include "SPIMaster.h"
 #include "Utils.h"
 
+#define DITHERING_BENCHMARK_FRAMES 120
+#define DITHERING_BENCHMARK_RENDER_MODE 8
+#define DITHERING_BENCHMARK_SPRITE_SIZE 16
+
 namespace Benchmark {
 
 inline void main(uint32_t renderMode) {
@@ -47,6 +56,123 @@ inline void main(uint32_t renderMode) {
   }
 }
 
+inline void generateGradient(uint32_t frame, int x, int y, uint8_t* rgb) {
+  // (a sky that slowly gets brighter, with a sprite moving over it)
+  int width = RENDER_MODE_WIDTH[DITHERING_BENCHMARK_RENDER_MODE];
+  int spriteX = (frame * 2) % (width - DITHERING_BENCHMARK_SPRITE_SIZE);
+  if (x >= spriteX && x < spriteX + DITHERING_BENCHMARK_SPRITE_SIZE &&
+      y >= 72 && y < 72 + DITHERING_BENCHMARK_SPRITE_SIZE) {
+    rgb[0] = 255;
+    rgb[1] = rgb[2] = 0;
+    return;
+  }
+
+  rgb[0] = std::min(40 + (int)frame + x / 4, 255);
+  rgb[1] = std::min(60 + (int)frame / 2 + y / 3, 255);
+  rgb[2] = std::max(200 - (int)frame / 4 - y / 4, 0);
+}
+
+inline void dithering() {
+  // (quantizes a synthetic sequence with different dithering strengths, and
+  //  reports the quantization time, the error and the resulting diff sizes)
+  PALETTE_initializeCache(PALETTE_CACHE_FILENAME);
+
+  uint32_t width = RENDER_MODE_WIDTH[DITHERING_BENCHMARK_RENDER_MODE];
+  uint32_t height = RENDER_MODE_HEIGHT[DITHERING_BENCHMARK_RENDER_MODE];
+  uint32_t totalPixels = RENDER_MODE_PIXELS[DITHERING_BENCHMARK_RENDER_MODE];
+  uint8_t* pixels = (uint8_t*)malloc(totalPixels);
+  uint8_t* previousPixels = (uint8_t*)malloc(totalPixels);
+  uint8_t* levelPixels = (uint8_t*)malloc(totalPixels);
+  auto dither = new OrderedDither();
+  auto diffs = new ImageDiffRLECompressor();
+
+  for (uint32_t strength = 0; strength <= DITHER_MAX_STRENGTH;
+       strength += DITHER_MAX_STRENGTH / 4) {
+    dither->initialize(strength);
+    uint64_t elapsedMicroseconds = 0;
+    uint64_t error = 0;
+    uint64_t packets[COMPRESSION_LEVELS] = {0};
+
+    for (uint32_t i = 0; i < DITHERING_BENCHMARK_FRAMES; i++) {
+      auto startTime = std::chrono::high_resolution_clock::now();
+      for (uint32_t y = 0; y < height; y++) {
+        for (uint32_t x = 0; x < width; x++) {
+          uint8_t rgb[3];
+          generateGradient(i, x, y, rgb);
+          pixels[y * width + x] =
+              LUT_24BPP_TO_8BIT_PALETTE[dither->isEnabled
+                                            ? dither->apply(x, y, rgb[0],
+                                                            rgb[1], rgb[2])
+                                            : (rgb[0] << 0) | (rgb[1] << 8) |
+                                                  (rgb[2] << 16)];
+        }
+      }
+      elapsedMicroseconds +=
+          std::chrono::duration_cast<std::chrono::microseconds>(
+              std::chrono::high_resolution_clock::now() - startTime)
+              .count();
+
+      // (the error is measured on 4x4 averages, like the eye sees it)
+      for (uint32_t y = 0; y < height; y += DITHER_MATRIX_SIZE) {
+        for (uint32_t x = 0; x < width; x += DITHER_MATRIX_SIZE) {
+          int sums[3] = {0};
+          for (int j = 0; j < DITHER_MATRIX_SIZE; j++) {
+            for (int k = 0; k < DITHER_MATRIX_SIZE; k++) {
+              uint8_t rgb[3];
+              generateGradient(i, x + k, y + j, rgb);
+              uint32_t color =
+                  MAIN_PALETTE_24BPP[pixels[(y + j) * width + x + k]];
+              for (int channel = 0; channel < 3; channel++)
+                sums[channel] += ((color >> (channel * 8)) & 0xff) -
+                                 rgb[channel];
+            }
+          }
+          for (int channel = 0; channel < 3; channel++)
+            error += abs(sums[channel]) / DITHER_CELLS;
+        }
+      }
+
+      if (i > 0) {
+        for (int level = 0; level < COMPRESSION_LEVELS; level++) {
+          // (the diff keeps the previous values of pixels under the
+          //  threshold, so each level works on its own copy)
+          memcpy(levelPixels, pixels, totalPixels);
+          Frame currentFrame = {totalPixels, levelPixels, MAIN_PALETTE_24BPP,
+                                NULL};
+          Frame previousFrame = {totalPixels, previousPixels,
+                                 MAIN_PALETTE_24BPP, NULL};
+          diffs->initialize(currentFrame, previousFrame,
+                            DIFF_THRESHOLDS[level],
+                            DITHERING_BENCHMARK_RENDER_MODE);
+          uint32_t diffStart = (diffs->startPixel / 8) / PACKET_SIZE;
+          packets[level] += diffs->expectedPackets() +
+                            (diffs->temporalDiffEndPacket > diffStart
+                                 ? diffs->temporalDiffEndPacket - diffStart
+                                 : 0);
+        }
+      }
+      memcpy(previousPixels, pixels, totalPixels);
+    }
+
+    std::string packetsPerLevel = "";
+    for (int level = 0; level < COMPRESSION_LEVELS; level++)
+      packetsPerLevel += " " + std::to_string(packets[level] /
+                                              (DITHERING_BENCHMARK_FRAMES - 1));
+    LOG("dithering " + std::to_string(strength) + "%: " +
+        std::to_string(elapsedMicroseconds / DITHERING_BENCHMARK_FRAMES) +
+        "us/frame, error " +
+        std::to_string(error / (totalPixels / DITHER_CELLS) /
+                       DITHERING_BENCHMARK_FRAMES) +
+        "/block, packets/frame (per compression level):" + packetsPerLevel);
+  }
+
+  delete dither;
+  delete diffs;
+  free(pixels);
+  free(previousPixels);
+  free(levelPixels);
+}
+
 }  // namespace Benchmark
 
 #endif  // BENCHMARK_H
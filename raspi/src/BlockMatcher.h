@@ -0,0 +1,88 @@
+#ifndef BLOCK_MATCHER_H
+#define BLOCK_MATCHER_H
+
+#include <stdint.h>
+#include "Frame.h"
+#include "FrameCommands.h"
+#include "Protocol.h"
+
+#define BLOCK_MIN_CHANGED_PIXELS 8
+#define BLOCK_MAX_FIRST_ROW_MISSES 2
+#define BLOCK_MAX_SEARCHES 192  // (per frame, to fit in the frame budget)
+#define BLOCK_COPY_COST PACKET_SIZE  // (a copy command costs ~4 pixels)
+
+typedef struct {
+  uint32_t copiedBlocks;
+
+  void findCopies(Frame currentFrame,
+                  Frame& previousFrame,
+                  FrameCommands& commands,
+                  uint32_t renderMode) {
+    // (copies are applied to `previousFrame` as soon as they're found, so
+    //  every search sees the screen exactly as the GBA will have it)
+    copiedBlocks = 0;
+    uint32_t searches = 0;
+    if (!previousFrame.hasData())
+      return;
+
+    int width = RENDER_MODE_WIDTH[renderMode];
+    int height = RENDER_MODE_HEIGHT[renderMode];
+
+    for (int y = 0; y < height; y += BLOCK_SIZE) {
+      for (int x = 0; x < width; x += BLOCK_SIZE) {
+        if (commands.isFull() || searches == BLOCK_MAX_SEARCHES)
+          return;
+
+        int blockWidth = std::min(BLOCK_SIZE, width - x);
+        int blockHeight = std::min(BLOCK_SIZE, height - y);
+        uint32_t changedPixels = currentFrame.countBlockMisses(
+            previousFrame, x, y, x, y, blockHeight, blockWidth, width,
+            BLOCK_SIZE * BLOCK_SIZE);
+        if (changedPixels < BLOCK_MIN_CHANGED_PIXELS)
+          continue;
+        searches++;
+
+        uint32_t bestMisses = changedPixels - BLOCK_COPY_COST;
+        int bestDx = 0, bestDy = 0;
+        int fromDx = std::max(-BLOCK_MAX_DISTANCE, x + blockWidth - width);
+        int toDx = std::min(BLOCK_MAX_DISTANCE, x);
+        int fromDy = std::max(-BLOCK_MAX_DISTANCE, y + blockHeight - height);
+        int toDy = std::min(BLOCK_MAX_DISTANCE, y);
+
+        for (int dy = fromDy; dy <= toDy && bestMisses > 0; dy++) {
+          for (int dx = fromDx; dx <= toDx; dx++) {
+            if (dx == 0 && dy == 0)
+              continue;
+
+            // (cheap rejection: most candidates fail on the first row)
+            if (currentFrame.countBlockMisses(previousFrame, x, y, x - dx,
+                                              y - dy, 1, blockWidth, width,
+                                              BLOCK_SIZE) >
+                BLOCK_MAX_FIRST_ROW_MISSES)
+              continue;
+
+            uint32_t misses = currentFrame.countBlockMisses(
+                previousFrame, x, y, x - dx, y - dy, blockHeight, blockWidth,
+                width, bestMisses);
+            if (misses < bestMisses) {
+              bestMisses = misses;
+              bestDx = dx;
+              bestDy = dy;
+              if (misses == 0)
+                break;
+            }
+          }
+        }
+
+        if (bestDx != 0 || bestDy != 0) {
+          commands.addCopyBlock(x / BLOCK_SIZE, y / BLOCK_SIZE, bestDx, bestDy);
+          previousFrame.copyBlock(x, y, blockWidth, blockHeight, bestDx, bestDy,
+                                  width);
+          copiedBlocks++;
+        }
+      }
+    }
+  }
+} BlockMatcher;
+
+#endif  // BLOCK_MATCHER_H
@@ -2,10 +2,12 @@
 #define BUILD_CONFIG_H
 
 // #define WITH_AUDIO
+// #define WITH_LATENCY_PROBE  // (on both sides)
 
 #define PROFILE
 // #define PROFILE_VERBOSE
 // #define DEBUG
 // #define DEBUG_PNG
+// #define BENCHMARK_DITHERING
 
 #endif  // BUILD_CONFIG_H
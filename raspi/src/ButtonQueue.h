@@ -0,0 +1,52 @@
+#ifndef BUTTON_QUEUE_H
+#define BUTTON_QUEUE_H
+
+#include <semaphore.h>
+#include <stdint.h>
+#include <atomic>
+
+#define BUTTON_QUEUE_SIZE 64  // (a power of two)
+
+class ButtonQueue {
+  // (a lock-free ring with one producer and one consumer: the SPI thread
+  //  pushes button states and the input thread writes them to uinput; the
+  //  semaphore only wakes up the consumer)
+ public:
+  ButtonQueue() {
+    head = 0;
+    tail = 0;
+    sem_init(&available, 0, 0);
+  }
+
+  bool push(uint16_t buttons) {
+    uint32_t tail = this->tail.load(std::memory_order_relaxed);
+    if (tail - head.load(std::memory_order_acquire) == BUTTON_QUEUE_SIZE)
+      return false;
+
+    states[tail % BUTTON_QUEUE_SIZE] = buttons;
+    this->tail.store(tail + 1, std::memory_order_release);
+    sem_post(&available);
+    return true;
+  }
+
+  uint16_t pop() {
+    // (blocks until there's a state)
+    while (sem_wait(&available) != 0)
+      ;
+
+    uint32_t head = this->head.load(std::memory_order_relaxed);
+    uint16_t buttons = states[head % BUTTON_QUEUE_SIZE];
+    this->head.store(head + 1, std::memory_order_release);
+    return buttons;
+  }
+
+  ~ButtonQueue() { sem_destroy(&available); }
+
+ private:
+  uint16_t states[BUTTON_QUEUE_SIZE];
+  std::atomic<uint32_t> head;
+  std::atomic<uint32_t> tail;
+  sem_t available;
+};
+
+#endif  // BUTTON_QUEUE_H
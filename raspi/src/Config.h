@@ -2,16 +2,57 @@
 #define CONFIG_H
 
 #include <stdint.h>
+#include <string.h>
 #include <fstream>
 #include <streambuf>
+#include <vector>
 #include "SPIMaster.h"
 #include "Utils.h"
 
+#define MAX_STATIONS 4
+#define STATION_KEY_PREFIX "STATION_"
+
+typedef struct {
+  std::string link = "";  // ("spi0", "spi1" or "simulated")
+  std::string gamepadName = "";
+  bool hasCrop = false;
+  uint32_t cropLeft = 0;
+  uint32_t cropTop = 0;
+  uint32_t cropRight = 0;
+  uint32_t cropBottom = 0;
+} StationConfig;
+
 class Config {
  public:
   SPITiming spiNormalTiming;
   SPITiming spiOverclockedTiming;
   std::string virtualGamepadName = "";
+  uint32_t targetFps = 0;
+  bool deadlineMode = false;
+  bool dynamicResolution = false;
+  bool interlaced = false;
+  uint32_t dithering = 0;
+  bool adaptivePalette = false;
+  bool packedPixels = false;
+  bool scanOrders = false;
+  uint32_t cropLeft = 0;
+  uint32_t cropTop = 0;
+  uint32_t cropRight = 0;
+  uint32_t cropBottom = 0;
+  bool letterboxRemoval = false;
+  bool duplicateDetection = false;
+  std::string frameSource = "dispmanx";
+  std::string sharedMemoryName = "/gba-remote-play";
+  std::string rawSourceFile = "";
+  uint32_t rawSourceWidth = 0;
+  uint32_t rawSourceHeight = 0;
+  uint32_t rawSourceBytesPerPixel = 3;
+  std::string relayMode = "none";
+  std::string relayAddress = "";
+  std::string metricsSocket = "";  // (empty = no stats socket)
+  std::string traceFile = "";      // (empty = no trace dumps)
+  uint32_t totalStations = 1;
+  std::vector<StationConfig> stations;
 
   Config(std::string fileName) {
     std::ifstream file(fileName);
@@ -21,12 +62,20 @@ class Config {
     spiNormalTiming.reset();
     spiOverclockedTiming.reset();
     parse(data);
+    if (packedPixels)
+      adaptivePalette = true;  // (4bpp pixels need a 16-color scene palette)
+    completeStations();
 
     if (!spiNormalTiming.slowFrequency || !spiNormalTiming.fastFrequency ||
         !spiNormalTiming.delayMicroseconds ||
         !spiOverclockedTiming.slowFrequency ||
         !spiOverclockedTiming.fastFrequency ||
-        !spiOverclockedTiming.delayMicroseconds || virtualGamepadName == "") {
+        !spiOverclockedTiming.delayMicroseconds || virtualGamepadName == "" ||
+        (frameSource != "dispmanx" && frameSource != "fbdev" &&
+         frameSource != "shm" && frameSource != "raw") ||
+        (relayMode != "none" && relayMode != "encoder" &&
+         relayMode != "client") ||
+        (relayMode != "none" && relayAddress == "") || !areStationsValid()) {
       std::cout << "Error (Config): invalid configuration, check " + fileName +
                        "\n";
       exit(1);
@@ -59,8 +108,128 @@ class Config {
         spiOverclockedTiming.delayMicroseconds = std::stoi(value);
       else if (key == "VIRTUAL_GAMEPAD_NAME")
         virtualGamepadName = value;
+      else if (key == "TARGET_FPS")
+        targetFps = std::stoi(value);
+      else if (key == "DEADLINE_MODE")
+        deadlineMode = std::stoi(value) == 1;
+      else if (key == "DYNAMIC_RESOLUTION")
+        dynamicResolution = std::stoi(value) == 1;
+      else if (key == "INTERLACED")
+        interlaced = std::stoi(value) == 1;
+      else if (key == "DITHERING")
+        dithering = std::stoi(value);
+      else if (key == "ADAPTIVE_PALETTE")
+        adaptivePalette = std::stoi(value) == 1;
+      else if (key == "PACKED_PIXELS")
+        packedPixels = std::stoi(value) == 1;
+      else if (key == "SCAN_ORDERS")
+        scanOrders = std::stoi(value) == 1;
+      else if (key == "CROP_LEFT")
+        cropLeft = std::stoi(value);
+      else if (key == "CROP_TOP")
+        cropTop = std::stoi(value);
+      else if (key == "CROP_RIGHT")
+        cropRight = std::stoi(value);
+      else if (key == "CROP_BOTTOM")
+        cropBottom = std::stoi(value);
+      else if (key == "LETTERBOX_REMOVAL")
+        letterboxRemoval = std::stoi(value) == 1;
+      else if (key == "DUPLICATE_DETECTION")
+        duplicateDetection = std::stoi(value) == 1;
+      else if (key == "FRAME_SOURCE")
+        frameSource = value;
+      else if (key == "SHARED_MEMORY_NAME")
+        sharedMemoryName = value;
+      else if (key == "RAW_SOURCE_FILE")
+        rawSourceFile = value;
+      else if (key == "RAW_SOURCE_WIDTH")
+        rawSourceWidth = std::stoi(value);
+      else if (key == "RAW_SOURCE_HEIGHT")
+        rawSourceHeight = std::stoi(value);
+      else if (key == "RAW_SOURCE_BYTES_PER_PIXEL")
+        rawSourceBytesPerPixel = std::stoi(value);
+      else if (key == "RELAY_MODE")
+        relayMode = value;
+      else if (key == "RELAY_ADDRESS")
+        relayAddress = value;
+      else if (key == "METRICS_SOCKET")
+        metricsSocket = value;
+      else if (key == "TRACE_FILE")
+        traceFile = value;
+      else if (key == "STATIONS")
+        totalStations = std::stoi(value);
+      else if (key.rfind(STATION_KEY_PREFIX, 0) == 0)
+        parseStation(key.substr(strlen(STATION_KEY_PREFIX)), value);
+    }
+  }
+
+  void parseStation(std::string key, std::string value) {
+    // (STATION_<number>_<KEY>, numbered from 1)
+    size_t separator = key.find('_');
+    if (separator == std::string::npos)
+      return;
+    uint32_t number = std::stoi(key.substr(0, separator));
+    auto field = key.substr(separator + 1);
+    if (number == 0 || number > MAX_STATIONS)
+      return;
+    if (stations.size() < number)
+      stations.resize(number);
+    auto& station = stations[number - 1];
+
+    if (field == "LINK")
+      station.link = value;
+    else if (field == "GAMEPAD_NAME")
+      station.gamepadName = value;
+    else if (field == "CROP") {
+      auto crop = split(value, ",");
+      if (crop.size() != 4)
+        return;
+      station.hasCrop = true;
+      station.cropLeft = std::stoi(crop.at(0));
+      station.cropTop = std::stoi(crop.at(1));
+      station.cropRight = std::stoi(crop.at(2));
+      station.cropBottom = std::stoi(crop.at(3));
     }
   }
+
+  void completeStations() {
+    // (the first station uses the global settings, like a single GBA)
+    if (totalStations == 0 || totalStations > MAX_STATIONS)
+      return;
+    stations.resize(totalStations);
+
+    for (uint32_t i = 0; i < totalStations; i++) {
+      auto& station = stations[i];
+      if (station.link == "" && i < 2)
+        station.link = "spi" + std::to_string(i);
+      if (station.gamepadName == "")
+        station.gamepadName =
+            virtualGamepadName + (i > 0 ? " " + std::to_string(i + 1) : "");
+      if (!station.hasCrop) {
+        station.cropLeft = cropLeft;
+        station.cropTop = cropTop;
+        station.cropRight = cropRight;
+        station.cropBottom = cropBottom;
+      }
+    }
+  }
+
+  bool areStationsValid() {
+    if (totalStations == 0 || totalStations > MAX_STATIONS ||
+        (totalStations > 1 && relayMode != "none"))
+      return false;
+
+    for (uint32_t i = 0; i < totalStations; i++) {
+      auto link = stations[i].link;
+      if (link != "spi0" && link != "spi1" && link != "simulated")
+        return false;
+      for (uint32_t j = 0; j < i; j++)
+        if (link != "simulated" && stations[j].link == link)
+          return false;
+    }
+
+    return true;
+  }
 };
 
 #endif  // CONFIG_H
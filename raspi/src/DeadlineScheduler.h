@@ -0,0 +1,130 @@
+#ifndef DEADLINE_SCHEDULER_H
+#define DEADLINE_SCHEDULER_H
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include "Frame.h"
+#include "FrameCommands.h"
+#include "ImageDiffRLECompressor.h"
+#include "Protocol.h"
+
+#define DEADLINE_BLOCK_SIZE 8
+#define DEADLINE_MAX_BLOCKS \
+  ((DRAW_WIDTH / DEADLINE_BLOCK_SIZE) * (DRAW_HEIGHT / DEADLINE_BLOCK_SIZE))
+#define DEADLINE_MAX_AGE 255
+
+typedef struct {
+  uint32_t postponedBlocks;
+
+  void reset() { memset(ages, 0, sizeof(ages)); }
+
+  bool trim(Frame& currentFrame,
+            Frame previousFrame,
+            ImageDiffRLECompressor& diffs,
+            uint32_t fixedPackets,
+            uint32_t packetBudget,
+            uint32_t renderMode) {
+    // (when the frame doesn't fit in the budget, the blocks with more changes
+    //  (where the motion is) are sent first, and the rest keep their previous
+    //  values => they're still dirty in the next frame's diff)
+    postponedBlocks = 0;
+    uint32_t diffStart = (diffs.startPixel / 8) / PACKET_SIZE;
+    if (diffs.temporalDiffEndPacket > diffStart)
+      fixedPackets += diffs.temporalDiffEndPacket - diffStart;
+    if (packetBudget == 0 || !previousFrame.hasData() ||
+        diffs.expectedPackets() + fixedPackets <= packetBudget) {
+      // (the whole frame is sent, so nothing is carried over anymore)
+      reset();
+      return false;
+    }
+
+    int width = RENDER_MODE_WIDTH[renderMode];
+    int height = RENDER_MODE_HEIGHT[renderMode];
+    int blocksPerRow = (width + DEADLINE_BLOCK_SIZE - 1) / DEADLINE_BLOCK_SIZE;
+    uint32_t totalBlocks = 0;
+    uint32_t changedPixels[DEADLINE_MAX_BLOCKS];
+    uint32_t changedBlocks[DEADLINE_MAX_BLOCKS];
+    uint32_t priorities[DEADLINE_MAX_BLOCKS];
+
+    for (int y = 0; y < height; y += DEADLINE_BLOCK_SIZE) {
+      for (int x = 0; x < width; x += DEADLINE_BLOCK_SIZE) {
+        uint32_t block = (y / DEADLINE_BLOCK_SIZE) * blocksPerRow +
+                         x / DEADLINE_BLOCK_SIZE;
+        changedPixels[block] = countChanges(diffs, x, y, width, height);
+        if (changedPixels[block] == 0) {
+          ages[block] = 0;
+          continue;
+        }
+
+        // (postponed blocks get older, so they can't starve)
+        priorities[block] = changedPixels[block] * (1 + ages[block]);
+        changedBlocks[totalBlocks++] = block;
+      }
+    }
+
+    std::sort(changedBlocks, changedBlocks + totalBlocks,
+              [&priorities](uint32_t a, uint32_t b) {
+                return priorities[a] > priorities[b];
+              });
+
+    uint32_t availablePixels =
+        packetBudget > fixedPackets
+            ? (packetBudget - fixedPackets) * PIXELS_PER_PACKET
+            : 0;
+    uint32_t usedPixels = 0;
+
+    for (uint32_t i = 0; i < totalBlocks; i++) {
+      uint32_t block = changedBlocks[i];
+      bool isFirst = i == 0;  // (at least one block is always sent)
+      if (isFirst || usedPixels + changedPixels[block] <= availablePixels) {
+        usedPixels += changedPixels[block];
+        ages[block] = 0;
+        continue;
+      }
+
+      int x = (block % blocksPerRow) * DEADLINE_BLOCK_SIZE;
+      int y = (block / blocksPerRow) * DEADLINE_BLOCK_SIZE;
+      restoreBlock(currentFrame, previousFrame, x, y, width, height);
+      ages[block] = std::min(ages[block] + 1, DEADLINE_MAX_AGE);
+      postponedBlocks++;
+    }
+
+    return postponedBlocks > 0;
+  }
+
+ private:
+  uint8_t ages[DEADLINE_MAX_BLOCKS];
+
+  uint32_t countChanges(ImageDiffRLECompressor& diffs,
+                        int x,
+                        int y,
+                        int width,
+                        int height) {
+    uint32_t changes = 0;
+    int toX = std::min(x + DEADLINE_BLOCK_SIZE, width);
+    int toY = std::min(y + DEADLINE_BLOCK_SIZE, height);
+
+    for (int row = y; row < toY; row++)
+      for (int column = x; column < toX; column++)
+        changes += diffs.hasPixelChanged(row * width + column);
+
+    return changes;
+  }
+
+  void restoreBlock(Frame& currentFrame,
+                    Frame& previousFrame,
+                    int x,
+                    int y,
+                    int width,
+                    int height) {
+    int blockWidth = std::min(DEADLINE_BLOCK_SIZE, width - x);
+    int toY = std::min(y + DEADLINE_BLOCK_SIZE, height);
+
+    for (int row = y; row < toY; row++)
+      memcpy(currentFrame.raw8BitPixels + row * width + x,
+             previousFrame.raw8BitPixels + row * width + x, blockWidth);
+  }
+} DeadlineScheduler;
+
+#endif  // DEADLINE_SCHEDULER_H
@@ -0,0 +1,77 @@
+#ifndef DISPMANX_SOURCE_H
+#define DISPMANX_SOURCE_H
+
+#include <bcm_host.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <iostream>
+#include "FbdevSource.h"
+
+#define DISPMANX_IMAGE_MODE VC_IMAGE_ARGB8888
+
+class DispmanxSource : public FbdevSource {
+ public:
+  DispmanxSource() : FbdevSource(false) {
+    // (the frame buffer device only provides the resolution: the pixels are
+    //  copied from a GPU snapshot, so fullscreen OpenGL apps are captured too)
+    allocateBuffer();
+    pitch = width * FB_BYTES_PER_PIXEL;
+
+    openPrimaryDisplay();
+    createScreenResource();
+    setUpRect();
+  }
+
+  ~DispmanxSource() {
+    free(snapshot);
+    vc_dispmanx_resource_delete(screenResource);
+    vc_dispmanx_display_close(display);
+  }
+
+ protected:
+  uint8_t* capture() override {
+    vc_dispmanx_snapshot(display, screenResource, (DISPMANX_TRANSFORM_T)0);
+    vc_dispmanx_resource_read_data(screenResource, &rect, snapshot, pitch);
+
+    return snapshot;
+  }
+
+ private:
+  uint8_t* snapshot;
+  DISPMANX_DISPLAY_HANDLE_T display;
+  DISPMANX_RESOURCE_HANDLE_T screenResource;
+  uint32_t image_prt;
+  VC_RECT_T rect;
+
+  void allocateBuffer() {
+    snapshot = (uint8_t*)malloc(fixedInfo.smem_len);
+    if (snapshot == NULL) {
+      std::cout << "Error (Image): malloc(" +
+                       std::to_string(fixedInfo.smem_len) + ") failed\n";
+      exit(27);
+    }
+  }
+
+  void openPrimaryDisplay() {
+    bcm_host_init();
+
+    display = vc_dispmanx_display_open(0);
+    if (display == DISPMANX_NO_HANDLE) {
+      std::cout << "Error (Image): cannot open primary display\n";
+      exit(28);
+    }
+  }
+
+  void createScreenResource() {
+    screenResource = vc_dispmanx_resource_create(DISPMANX_IMAGE_MODE, width,
+                                                 height, &image_prt);
+    if (screenResource == DISPMANX_NO_HANDLE) {
+      printf("Error (Image): cannot create screen resource\n");
+      exit(29);
+    }
+  }
+
+  void setUpRect() { vc_dispmanx_rect_set(&rect, 0, 0, width, height); }
+};
+
+#endif  // DISPMANX_SOURCE_H
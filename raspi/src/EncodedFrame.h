@@ -0,0 +1,49 @@
+#ifndef ENCODED_FRAME_H
+#define ENCODED_FRAME_H
+
+#include <stdint.h>
+#include <string.h>
+#include "Protocol.h"
+
+#define TEMPORAL_DIFF_PACKETS TEMPORAL_DIFF_MAX_PACKETS(TOTAL_SCREEN_PIXELS)
+
+typedef struct {
+  // (everything the GBA receives in a frame, already encoded as packets, so
+  //  it can be sent by the same process or by a relay client)
+  uint32_t metadata;
+  uint32_t diffEnd;  // (the diff end packet, with its flags)
+  uint32_t diffStartPacket;
+  uint32_t diffEndPacket;
+  uint32_t temporalDiffs[TEMPORAL_DIFF_PACKETS];
+  bool hasAudio;
+  uint32_t audio[AUDIO_SIZE_PACKETS];
+  uint32_t totalCommandPackets;
+  uint32_t commands[COMMANDS_MAX_PACKETS];
+  uint32_t totalPixelPackets;
+  uint32_t pixels[MAX_PIXELS_SIZE];
+
+  void setAudio(uint8_t* audioChunk) {
+    hasAudio = audioChunk != NULL;
+    if (hasAudio)
+      memcpy(audio, audioChunk, AUDIO_SIZE_PACKETS * PACKET_SIZE);
+  }
+
+  uint32_t totalDiffPackets() {
+    return diffEndPacket > diffStartPacket ? diffEndPacket - diffStartPacket
+                                           : 0;
+  }
+
+  uint32_t totalPackets() {
+    return totalDiffPackets() + (hasAudio ? AUDIO_SIZE_PACKETS : 0) +
+           totalCommandPackets + totalPixelPackets;
+  }
+
+  bool isValid() {
+    return diffStartPacket <= TEMPORAL_DIFF_PACKETS &&
+           diffEndPacket <= TEMPORAL_DIFF_PACKETS &&
+           totalCommandPackets <= COMMANDS_MAX_PACKETS &&
+           totalPixelPackets <= MAX_PIXELS_SIZE;
+  }
+} EncodedFrame;
+
+#endif  // ENCODED_FRAME_H
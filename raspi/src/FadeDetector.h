@@ -0,0 +1,153 @@
+#ifndef FADE_DETECTOR_H
+#define FADE_DETECTOR_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "Frame.h"
+#include "Protocol.h"
+#include "Utils.h"
+
+#define FADE_SAMPLE_STEP 4
+#define FADE_MISS_RATIO 16  // (1/16 of different samples => not a fade)
+#define FADE_MIN_RANGE 48  // (average brightness room per sample, in RGB sum)
+#define FADE_MAX_DISTANCE_SQUARED 2048  // (~ half a palette step per channel)
+#define FILL_MISS_RATIO 16  // (1/16 of other colors => not a solid fill)
+
+typedef struct {
+  uint32_t level;
+  bool isWhite;
+  uint8_t fillColor;
+
+  bool detectFade(Frame currentFrame, Frame baseFrame, uint32_t renderMode) {
+    // (checks if `currentFrame` is `baseFrame` under the GBA's brightness
+    //  effect: the level is estimated from the average brightness and then
+    //  verified on a sampled grid)
+    level = 0;
+    isWhite = false;
+    if (!baseFrame.hasData())
+      return false;
+
+    int width = RENDER_MODE_WIDTH[renderMode];
+    int height = RENDER_MODE_HEIGHT[renderMode];
+    uint32_t totalSamples = 0;
+    int64_t currentBrightness = 0, baseBrightness = 0;
+
+    forEachSample(width, height, [&](uint32_t pixelId) {
+      currentBrightness += brightnessOf(currentFrame.getColorOf(pixelId));
+      baseBrightness += brightnessOf(baseFrame.getColorOf(pixelId));
+      totalSamples++;
+    });
+    if (currentBrightness == baseBrightness)
+      return false;
+
+    isWhite = currentBrightness > baseBrightness;
+    int64_t range = isWhite ? 0xff * 3 * totalSamples - baseBrightness
+                            : baseBrightness;
+    if (range < FADE_MIN_RANGE * totalSamples)
+      return false;
+
+    int64_t delta = llabs(currentBrightness - baseBrightness);
+    int estimatedLevel = (delta * FADE_MAX_LEVEL + range / 2) / range;
+    uint32_t bestMisses = totalSamples / FADE_MISS_RATIO + 1;
+
+    // (the estimation goes first, so it wins ties)
+    int candidates[] = {estimatedLevel, estimatedLevel - 1, estimatedLevel + 1};
+    for (int candidate : candidates) {
+      if (candidate < 1 || candidate > FADE_MAX_LEVEL)
+        continue;
+
+      uint32_t misses = countFadeMisses(currentFrame, baseFrame, width, height,
+                                        candidate, bestMisses);
+      if (misses < bestMisses) {
+        bestMisses = misses;
+        level = candidate;
+      }
+    }
+
+    return level > 0;
+  }
+
+  bool detectFill(Frame currentFrame,
+                  Frame previousFrame,
+                  uint32_t renderMode) {
+    // (flashes and cuts to a solid color are sent as a DMA fill, so only
+    //  the pixels that don't match the fill color are transferred)
+    if (!previousFrame.hasData())
+      return false;
+
+    int width = RENDER_MODE_WIDTH[renderMode];
+    int height = RENDER_MODE_HEIGHT[renderMode];
+    uint32_t histogram[PALETTE_COLORS] = {0};
+    uint32_t totalSamples = 0;
+
+    forEachSample(width, height, [&](uint32_t pixelId) {
+      histogram[currentFrame.raw8BitPixels[pixelId]]++;
+      totalSamples++;
+    });
+
+    fillColor = 0;
+    for (int i = 1; i < PALETTE_COLORS; i++)
+      if (histogram[i] > histogram[fillColor])
+        fillColor = i;
+    if (histogram[fillColor] < totalSamples - totalSamples / FILL_MISS_RATIO)
+      return false;
+
+    uint32_t previousMatches = 0;
+    forEachSample(width, height, [&](uint32_t pixelId) {
+      if (previousFrame.raw8BitPixels[pixelId] == fillColor)
+        previousMatches++;
+    });
+
+    return previousMatches < totalSamples / 2;
+  }
+
+ private:
+  template <typename F>
+  void forEachSample(int width, int height, F action) {
+    for (int y = FADE_SAMPLE_STEP / 2; y < height; y += FADE_SAMPLE_STEP)
+      for (int x = FADE_SAMPLE_STEP / 2; x < width; x += FADE_SAMPLE_STEP)
+        action(y * width + x);
+  }
+
+  uint32_t countFadeMisses(Frame& currentFrame,
+                           Frame& baseFrame,
+                           int width,
+                           int height,
+                           uint32_t candidate,
+                           uint32_t maxMisses) {
+    uint32_t misses = 0;
+
+    for (int y = FADE_SAMPLE_STEP / 2; y < height; y += FADE_SAMPLE_STEP) {
+      for (int x = FADE_SAMPLE_STEP / 2; x < width; x += FADE_SAMPLE_STEP) {
+        uint32_t pixelId = y * width + x;
+        uint32_t color = baseFrame.getColorOf(pixelId);
+        int r = fadeChannel((color >> 0) & 0xff, candidate);
+        int g = fadeChannel((color >> 8) & 0xff, candidate);
+        int b = fadeChannel((color >> 16) & 0xff, candidate);
+
+        if (getDistanceSquared(r, g, b, currentFrame.getColorOf(pixelId)) >
+                FADE_MAX_DISTANCE_SQUARED &&
+            ++misses >= maxMisses)
+          return misses;
+      }
+    }
+
+    return misses;
+  }
+
+  int fadeChannel(int value, uint32_t candidate) {
+    // (same math as the GBA hardware, which works with 5-bit channels)
+    int channel = value >> 3;
+    channel = isWhite ? channel + (((31 - channel) * candidate) >> 4)
+                      : channel - ((channel * candidate) >> 4);
+
+    return channel << 3;
+  }
+
+  int brightnessOf(uint32_t color) {
+    return ((color >> 0) & 0xff) + ((color >> 8) & 0xff) +
+           ((color >> 16) & 0xff);
+  }
+} FadeDetector;
+
+#endif  // FADE_DETECTOR_H
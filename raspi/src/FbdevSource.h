@@ -0,0 +1,106 @@
+#ifndef FBDEV_SOURCE_H
+#define FBDEV_SOURCE_H
+
+#include <linux/fb.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <iostream>
+#include "FrameSource.h"
+
+#define FB_DEVFILE "/dev/fb0"
+#define FB_BYTES_PER_PIXEL 4
+
+class FbdevSource : public FrameSource {
+ public:
+  FbdevSource(bool isMapped = true) {
+    openFrameBuffer();
+    retrieveFixedScreenInformation();
+    retrieveVariableScreenInformation();
+    width = variableInfo.xres;
+    height = variableInfo.yres;
+    format = SourceFormat{variableInfo.red.offset, variableInfo.green.offset,
+                          variableInfo.blue.offset};
+    if (isMapped)
+      mapFrameBuffer();
+  }
+
+  ~FbdevSource() {
+    if (mappedMemory != NULL)
+      munmap(mappedMemory, fixedInfo.smem_len);
+    close(fileDescriptor);
+  }
+
+ protected:
+  int fileDescriptor;
+  struct fb_fix_screeninfo fixedInfo;
+  struct fb_var_screeninfo variableInfo;
+  uint8_t* mappedMemory = NULL;
+
+  void mapFrameBuffer() {
+    // (zero-copy: pixels are read straight from the frame buffer device, but
+    //  only what's drawn through it (not through the GPU) is there)
+    mappedMemory = (uint8_t*)mmap(NULL, fixedInfo.smem_len, PROT_READ,
+                                  MAP_SHARED, fileDescriptor, 0);
+    if (mappedMemory == MAP_FAILED) {
+      std::cout << "Error (Image): cannot map framebuffer device\n";
+      exit(61);
+    }
+    pitch = fixedInfo.line_length;
+  }
+
+  uint8_t* capture() override {
+    // (the visible area can be panned inside the mapped memory, and double
+    //  buffered clients flip pages by panning, so it's read on every capture)
+    struct fb_var_screeninfo info;
+    if (ioctl(fileDescriptor, FBIOGET_VSCREENINFO, &info) == 0 &&
+        (uint64_t)(info.yoffset + height) * fixedInfo.line_length <=
+            fixedInfo.smem_len &&
+        (info.xoffset + width) * FB_BYTES_PER_PIXEL <= fixedInfo.line_length) {
+      variableInfo.xoffset = info.xoffset;
+      variableInfo.yoffset = info.yoffset;
+    }
+
+    return mappedMemory + variableInfo.yoffset * fixedInfo.line_length +
+           variableInfo.xoffset * FB_BYTES_PER_PIXEL;
+  }
+
+ private:
+  void openFrameBuffer() {
+    fileDescriptor = open(FB_DEVFILE, O_RDWR);
+    if (fileDescriptor < 0) {
+      std::cout << "Error (Image): cannot open framebuffer device\n";
+      exit(21);
+    }
+  }
+
+  void retrieveFixedScreenInformation() {
+    if (ioctl(fileDescriptor, FBIOGET_FSCREENINFO, &fixedInfo) < 0) {
+      std::cout << "Error (Image): cannot read fixed information\n";
+      exit(22);
+    }
+  }
+
+  void retrieveVariableScreenInformation() {
+    if (ioctl(fileDescriptor, FBIOGET_VSCREENINFO, &variableInfo) < 0) {
+      std::cout << "Error (Image): cannot read variable information\n";
+      exit(23);
+    }
+
+    if (variableInfo.bits_per_pixel / 8 != FB_BYTES_PER_PIXEL) {
+      std::cout << "Error (Image): only 32bpp is supported\n";
+      exit(24);
+    }
+
+    if (variableInfo.xres % FB_BYTES_PER_PIXEL != 0 ||
+        variableInfo.yres % FB_BYTES_PER_PIXEL != 0) {
+      std::cout << "Error (Image): resolution must be word-aligned\n";
+      exit(26);
+    }
+  }
+};
+
+#endif  // FBDEV_SOURCE_H
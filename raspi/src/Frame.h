@@ -3,9 +3,14 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+#include <algorithm>
 #include "Protocol.h"
 #include "Utils.h"
 
+#define BYTE_LOW_BITS 0x7f7f7f7f7f7f7f7fULL
+#define BYTE_HIGH_BITS 0x8080808080808080ULL
+
 typedef struct Frame {
   uint32_t totalPixels;
   uint8_t* raw8BitPixels;
@@ -26,6 +31,83 @@ typedef struct Frame {
                               threshold);
   }
 
+  void scroll(int dx, int dy, uint32_t width) {
+    // (same row order as the GBA, so exposed pixels keep their old values)
+    int height = totalPixels / width;
+    int fromX = std::max(dx, 0);
+    int toX = std::min((int)width + dx, (int)width);
+    uint8_t sourceLine[DRAW_WIDTH];
+
+    for (int i = 0; i < height; i++) {
+      int y = dy > 0 ? height - 1 - i : i;
+      int sourceY = y - dy;
+      if (sourceY < 0 || sourceY >= height)
+        continue;
+
+      memcpy(sourceLine, raw8BitPixels + sourceY * width, width);
+      uint8_t* line = raw8BitPixels + y * width;
+      for (int x = fromX; x < toX; x++)
+        line[x] = sourceLine[x - dx];
+    }
+  }
+
+  void copyBlock(uint32_t x,
+                 uint32_t y,
+                 uint32_t blockWidth,
+                 uint32_t blockHeight,
+                 int dx,
+                 int dy,
+                 uint32_t width) {
+    // (the whole source block is read before writing, like the GBA does)
+    uint8_t block[BLOCK_SIZE * BLOCK_SIZE];
+
+    for (int row = 0; row < blockHeight; row++)
+      memcpy(block + row * BLOCK_SIZE,
+             raw8BitPixels + (y - dy + row) * width + x - dx, blockWidth);
+    for (int row = 0; row < blockHeight; row++)
+      memcpy(raw8BitPixels + (y + row) * width + x, block + row * BLOCK_SIZE,
+             blockWidth);
+  }
+
+  uint32_t countBlockMisses(Frame& sourceFrame,
+                            int x,
+                            int y,
+                            int sourceX,
+                            int sourceY,
+                            int blockHeight,
+                            int blockWidth,
+                            int width,
+                            uint32_t maxMisses) {
+    // (compares 8 pixels at once, counting the non-zero bytes of a XOR)
+    uint32_t misses = 0;
+
+    for (int row = 0; row < blockHeight; row++) {
+      uint64_t current = 0, source = 0;
+      uint8_t* currentRow = raw8BitPixels + (y + row) * width + x;
+      uint8_t* sourceRow =
+          sourceFrame.raw8BitPixels + (sourceY + row) * width + sourceX;
+      if (blockWidth == BLOCK_SIZE) {
+        memcpy(&current, currentRow, BLOCK_SIZE);
+        memcpy(&source, sourceRow, BLOCK_SIZE);
+      } else {
+        memcpy(&current, currentRow, blockWidth);
+        memcpy(&source, sourceRow, blockWidth);
+      }
+
+      uint64_t difference = current ^ source;
+      uint64_t nonZeroBytes =
+          (((difference & BYTE_LOW_BITS) + BYTE_LOW_BITS) | difference) &
+          BYTE_HIGH_BITS;
+      misses += __builtin_popcountll(nonZeroBytes);
+      if (misses >= maxMisses)
+        return misses;
+    }
+
+    return misses;
+  }
+
+  void fill(uint8_t color) { memset(raw8BitPixels, color, totalPixels); }
+
   bool hasData() { return totalPixels > 0; }
   bool hasAudio() { return audioChunk != NULL; }
 
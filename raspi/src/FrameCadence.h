@@ -0,0 +1,75 @@
+#ifndef FRAME_CADENCE_H
+#define FRAME_CADENCE_H
+
+#include <stdint.h>
+#include <chrono>
+
+#define CADENCE_SMOOTHING 8  // (new intervals weigh 1/8)
+#define CADENCE_MAX_PERIOD_US 100000  // (longer gaps are pauses, not cadence)
+#define CADENCE_MAX_WAIT_US 4000
+#define CADENCE_POLL_US 1000
+
+class FrameCadence {
+ public:
+  uint32_t periodMicroseconds;
+
+  FrameCadence() { reset(); }
+
+  void reset() {
+    hasNewFrame = false;
+    periodMicroseconds = 0;
+    lastNewFrameTime = std::chrono::high_resolution_clock::now();
+  }
+
+  bool isDuplicate(bool hasChanged) {
+    // (`hasChanged` comes from the frame buffer's row hashes)
+    if (!hasChanged)
+      return true;
+
+    if (hasNewFrame)
+      measure();
+    else
+      lastNewFrameTime = std::chrono::high_resolution_clock::now();
+    hasNewFrame = true;
+    return false;
+  }
+
+  uint32_t expectedWaitMicroseconds() {
+    // (if a new frame is due really soon, it's better to wait for it than to
+    //  send the stale one and then a duplicate)
+    if (periodMicroseconds == 0)
+      return 0;
+
+    int64_t wait = (int64_t)periodMicroseconds - elapsedMicroseconds();
+    return wait > 0 && wait <= CADENCE_MAX_WAIT_US ? wait : 0;
+  }
+
+  uint32_t framesPerSecond() {
+    return periodMicroseconds > 0 ? 1000000 / periodMicroseconds : 0;
+  }
+
+ private:
+  bool hasNewFrame;
+  std::chrono::high_resolution_clock::time_point lastNewFrameTime;
+
+  void measure() {
+    int64_t interval = elapsedMicroseconds();
+    lastNewFrameTime = std::chrono::high_resolution_clock::now();
+    if (interval <= 0 || interval > CADENCE_MAX_PERIOD_US)
+      return;
+
+    periodMicroseconds =
+        periodMicroseconds == 0
+            ? interval
+            : periodMicroseconds +
+                  (interval - (int64_t)periodMicroseconds) / CADENCE_SMOOTHING;
+  }
+
+  int64_t elapsedMicroseconds() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::high_resolution_clock::now() - lastNewFrameTime)
+        .count();
+  }
+};
+
+#endif  // FRAME_CADENCE_H
@@ -0,0 +1,51 @@
+#ifndef FRAME_COMMANDS_H
+#define FRAME_COMMANDS_H
+
+#include <stdint.h>
+#include "Protocol.h"
+
+typedef struct {
+  uint32_t packets[COMMANDS_MAX_PACKETS];
+  uint32_t totalPackets = 0;
+
+  void addScroll(int dx, int dy) {
+    add(COMMAND_SCROLL, (uint8_t)dx | ((uint8_t)dy << 8));
+  }
+
+  void addCopyBlock(uint32_t blockX, uint32_t blockY, int dx, int dy) {
+    add(COMMAND_COPY_BLOCK, blockX | (blockY << 5) | ((dx & 0b111111) << 10) |
+                                ((dy & 0b111111) << 16));
+  }
+
+  void addFade(uint32_t level, bool isWhite) {
+    add(COMMAND_FADE, level | (isWhite ? FADE_WHITE_BIT_MASK : 0));
+  }
+
+  void addFill(uint8_t color) { add(COMMAND_FILL, color); }
+
+  void addStoreReference(uint32_t slot) { add(COMMAND_STORE_REFERENCE, slot); }
+
+  void addRestoreBlock(uint32_t slot, uint32_t blockX, uint32_t blockY) {
+    add(COMMAND_RESTORE_BLOCK, blockX | (blockY << 5) | (slot << 10));
+  }
+
+  void addSetRenderMode(uint32_t renderMode) {
+    add(COMMAND_SET_RENDER_MODE, renderMode);
+  }
+
+  void addSetPaletteColor(uint32_t index, uint16_t color) {
+    add(COMMAND_SET_PALETTE_COLOR,
+        (color & PALETTE_COLOR_BIT_MASK) | (index << PALETTE_INDEX_BIT_OFFSET));
+  }
+
+  bool hasCommands() { return totalPackets > 0; }
+  bool isFull() { return totalPackets == COMMANDS_MAX_PACKETS; }
+
+ private:
+  void add(uint32_t id, uint32_t arguments) {
+    packets[totalPackets] = (id << COMMAND_ID_BIT_OFFSET) | arguments;
+    totalPackets++;
+  }
+} FrameCommands;
+
+#endif  // FRAME_COMMANDS_H
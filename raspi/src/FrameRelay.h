@@ -0,0 +1,313 @@
+#ifndef FRAME_RELAY_H
+#define FRAME_RELAY_H
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "EncodedFrame.h"
+#include "Utils.h"
+
+// A relay splits the work between two processes (or two machines):
+// - the encoder captures, quantizes and diffs the frames (RELAY_MODE=encoder)
+// - the client only talks to the GBA over SPI (RELAY_MODE=client)
+// Messages are native-endian words: [type, payload words, ...payload].
+// The client requests each frame with the keys and the stats of the previous
+// transfer, which also tells the encoder that the GBA has that frame now.
+// Addresses are "host:port" (TCP) or a path starting with "/" (Unix socket).
+
+#define RELAY_MESSAGE_RESET 1  // (client -> encoder: [resetPacket])
+#define RELAY_MESSAGE_REQUEST 2  // (client -> encoder: [keys, packets, us])
+#define RELAY_MESSAGE_FRAME 3  // (encoder -> client: an `EncodedFrame`)
+#define RELAY_FRAME_HEADER_WORDS 7
+#define RELAY_MAX_PAYLOAD_WORDS                                           \
+  (RELAY_FRAME_HEADER_WORDS + TEMPORAL_DIFF_PACKETS + AUDIO_SIZE_PACKETS + \
+   COMMANDS_MAX_PACKETS + MAX_PIXELS_SIZE)
+#define RELAY_RETRY_SECONDS 1
+
+typedef struct {
+  uint32_t type;
+  std::vector<uint32_t> payload;
+} RelayMessage;
+
+class FrameRelay {
+ public:
+  FrameRelay(std::string address, bool isServer) {
+    this->address = address;
+    this->isServer = isServer;
+    listenSocket = -1;
+    connectedSocket = -1;
+    if (isServer)
+      startListening();
+  }
+
+  void waitForPeer() {
+    // (blocks until there's a connection: the encoder accepts one client at a
+    //  time, and the client retries until the encoder is up)
+    disconnect();
+    bool isWaiting = false;
+
+    while (connectedSocket < 0) {
+      if (isServer)
+        connectedSocket = accept(listenSocket, NULL, NULL);
+      else
+        connectedSocket = connectToServer();
+
+      if (connectedSocket < 0) {
+        if (!isWaiting && !isServer)
+          std::cout << "Waiting for the relay encoder on " + address + "...\n";
+        isWaiting = true;
+        sleep(RELAY_RETRY_SECONDS);
+      }
+    }
+
+    if (!isUnixSocket()) {
+      int isEnabled = 1;
+      setsockopt(connectedSocket, IPPROTO_TCP, TCP_NODELAY, &isEnabled,
+                 sizeof(isEnabled));
+    }
+    LOG(isServer ? "Relay client connected!" : "Relay encoder connected!");
+  }
+
+  bool sendReset(uint32_t resetPacket) {
+    outgoing.clear();
+    outgoing.push_back(resetPacket);
+    return sendMessage(RELAY_MESSAGE_RESET);
+  }
+
+  bool sendRequest(uint16_t keys,
+                   uint32_t packets,
+                   uint32_t elapsedMicroseconds) {
+    outgoing.clear();
+    outgoing.push_back(keys);
+    outgoing.push_back(packets);
+    outgoing.push_back(elapsedMicroseconds);
+    return sendMessage(RELAY_MESSAGE_REQUEST);
+  }
+
+  bool sendFrame(EncodedFrame& frame) {
+    outgoing.clear();
+    outgoing.push_back(frame.metadata);
+    outgoing.push_back(frame.diffEnd);
+    outgoing.push_back(frame.diffStartPacket);
+    outgoing.push_back(frame.diffEndPacket);
+    outgoing.push_back(frame.hasAudio);
+    outgoing.push_back(frame.totalCommandPackets);
+    outgoing.push_back(frame.totalPixelPackets);
+    append(frame.temporalDiffs + frame.diffStartPacket,
+           frame.totalDiffPackets());
+    if (frame.hasAudio)
+      append(frame.audio, AUDIO_SIZE_PACKETS);
+    append(frame.commands, frame.totalCommandPackets);
+    append(frame.pixels, frame.totalPixelPackets);
+    return sendMessage(RELAY_MESSAGE_FRAME);
+  }
+
+  bool receive(RelayMessage& message) {
+    uint32_t header[2];
+    if (!readAll(header, sizeof(header)))
+      return fail("connection lost");
+    if (header[1] > RELAY_MAX_PAYLOAD_WORDS)
+      return fail("invalid message");
+
+    message.type = header[0];
+    message.payload.resize(header[1]);
+    return readAll(message.payload.data(), header[1] * PACKET_SIZE) ||
+           fail("connection lost");
+  }
+
+  bool receiveFrame(EncodedFrame& frame) {
+    if (!receive(incoming))
+      return false;
+    if (incoming.type != RELAY_MESSAGE_FRAME ||
+        incoming.payload.size() < RELAY_FRAME_HEADER_WORDS)
+      return fail("unexpected message");
+
+    uint32_t* words = incoming.payload.data();
+    frame.metadata = words[0];
+    frame.diffEnd = words[1];
+    frame.diffStartPacket = words[2];
+    frame.diffEndPacket = words[3];
+    frame.hasAudio = words[4];
+    frame.totalCommandPackets = words[5];
+    frame.totalPixelPackets = words[6];
+    if (!frame.isValid() ||
+        incoming.payload.size() !=
+            RELAY_FRAME_HEADER_WORDS + frame.totalPackets())
+      return fail("invalid frame");
+
+    words += RELAY_FRAME_HEADER_WORDS;
+    words = extract(words, frame.temporalDiffs + frame.diffStartPacket,
+                    frame.totalDiffPackets());
+    if (frame.hasAudio)
+      words = extract(words, frame.audio, AUDIO_SIZE_PACKETS);
+    words = extract(words, frame.commands, frame.totalCommandPackets);
+    extract(words, frame.pixels, frame.totalPixelPackets);
+    return true;
+  }
+
+  ~FrameRelay() {
+    disconnect();
+    if (listenSocket >= 0)
+      close(listenSocket);
+    if (isServer && isUnixSocket())
+      unlink(address.c_str());
+  }
+
+ private:
+  std::string address;
+  bool isServer;
+  int listenSocket;
+  int connectedSocket;
+  std::vector<uint32_t> outgoing;
+  RelayMessage incoming;
+
+  bool sendMessage(uint32_t type) {
+    uint32_t header[2] = {type, (uint32_t)outgoing.size()};
+    return (writeAll(header, sizeof(header)) &&
+            writeAll(outgoing.data(), outgoing.size() * PACKET_SIZE)) ||
+           fail("connection lost");
+  }
+
+  void append(uint32_t* packets, uint32_t count) {
+    outgoing.insert(outgoing.end(), packets, packets + count);
+  }
+
+  uint32_t* extract(uint32_t* words, uint32_t* packets, uint32_t count) {
+    memcpy(packets, words, count * PACKET_SIZE);
+    return words + count;
+  }
+
+  bool writeAll(void* data, uint32_t size) {
+    uint8_t* bytes = (uint8_t*)data;
+    while (size > 0) {
+      ssize_t written = send(connectedSocket, bytes, size, MSG_NOSIGNAL);
+      if (written <= 0)
+        return false;
+      bytes += written;
+      size -= written;
+    }
+
+    return true;
+  }
+
+  bool readAll(void* data, uint32_t size) {
+    uint8_t* bytes = (uint8_t*)data;
+    while (size > 0) {
+      ssize_t received = recv(connectedSocket, bytes, size, 0);
+      if (received <= 0)
+        return false;
+      bytes += received;
+      size -= received;
+    }
+
+    return true;
+  }
+
+  bool fail(std::string reason) {
+    LOG("Relay error: " + reason);
+    disconnect();
+    return false;
+  }
+
+  void disconnect() {
+    if (connectedSocket >= 0)
+      close(connectedSocket);
+    connectedSocket = -1;
+  }
+
+  void startListening() {
+    if (isUnixSocket()) {
+      unlink(address.c_str());
+      struct sockaddr_un unixAddress = createUnixAddress();
+      listenSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+      if (listenSocket < 0 ||
+          bind(listenSocket, (struct sockaddr*)&unixAddress,
+               sizeof(unixAddress)) < 0)
+        exitWithError();
+    } else {
+      struct addrinfo* info = resolve(true);
+      listenSocket = socket(info->ai_family, SOCK_STREAM, 0);
+      int isEnabled = 1;
+      setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, &isEnabled,
+                 sizeof(isEnabled));
+      bool isBound = listenSocket >= 0 &&
+                     bind(listenSocket, info->ai_addr, info->ai_addrlen) == 0;
+      freeaddrinfo(info);
+      if (!isBound)
+        exitWithError();
+    }
+
+    if (listen(listenSocket, 1) < 0)
+      exitWithError();
+    LOG("Relay encoder listening on " + address);
+  }
+
+  int connectToServer() {
+    int clientSocket;
+    bool isConnected;
+    if (isUnixSocket()) {
+      struct sockaddr_un unixAddress = createUnixAddress();
+      clientSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+      isConnected = clientSocket >= 0 &&
+                    connect(clientSocket, (struct sockaddr*)&unixAddress,
+                            sizeof(unixAddress)) == 0;
+    } else {
+      struct addrinfo* info = resolve(false);
+      clientSocket = socket(info->ai_family, SOCK_STREAM, 0);
+      isConnected = clientSocket >= 0 &&
+                    connect(clientSocket, info->ai_addr, info->ai_addrlen) == 0;
+      freeaddrinfo(info);
+    }
+
+    if (!isConnected && clientSocket >= 0)
+      close(clientSocket);
+    return isConnected ? clientSocket : -1;
+  }
+
+  struct sockaddr_un createUnixAddress() {
+    struct sockaddr_un unixAddress;
+    memset(&unixAddress, 0, sizeof(unixAddress));
+    unixAddress.sun_family = AF_UNIX;
+    if (address.size() >= sizeof(unixAddress.sun_path))
+      exitWithError();
+    strcpy(unixAddress.sun_path, address.c_str());
+    return unixAddress;
+  }
+
+  struct addrinfo* resolve(bool isPassive) {
+    size_t separator = address.rfind(':');
+    if (separator == std::string::npos)
+      exitWithError();
+    std::string host = address.substr(0, separator);
+    std::string port = address.substr(separator + 1);
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = isPassive ? AI_PASSIVE : 0;
+    struct addrinfo* info;
+    if (getaddrinfo(host.empty() ? NULL : host.c_str(), port.c_str(), &hints,
+                    &info) != 0)
+      exitWithError();
+    return info;
+  }
+
+  bool isUnixSocket() { return !address.empty() && address[0] == '/'; }
+
+  void exitWithError() {
+    std::cout << "Error (FrameRelay): cannot use relay address " + address +
+                     "\n";
+    exit(71);
+  }
+};
+
+#endif  // FRAME_RELAY_H
@@ -0,0 +1,97 @@
+#ifndef FRAME_SOURCE_H
+#define FRAME_SOURCE_H
+
+#include <stdint.h>
+#include <vector>
+#include "AreaDownscaler.h"
+
+#define FRAME_SOURCE_HASH_BASIS 0x811c9dc5
+#define FRAME_SOURCE_HASH_PRIME 0x01000193
+
+class FrameSource {
+ public:
+  std::vector<bool> changedRows;  // (since the previous `loadFrame()`)
+  bool hasChanged;
+
+  void initialize() {
+    // (called once the backend knows its resolution and pixel format)
+    rowHashes.resize(height);
+    previousRowHashes.resize(height);
+    changedRows.resize(height);
+    hasHashes = false;
+  }
+
+  uint8_t* loadFrame() {
+    buffer = capture();
+    hashRows();
+
+    return buffer;
+  }
+
+  AreaDownscaler* createDownscaler(uint32_t cropLeft,
+                                   uint32_t cropTop,
+                                   uint32_t cropRight,
+                                   uint32_t cropBottom,
+                                   bool removeLetterbox) {
+    // (each downscaler is a viewport into the source frame)
+    return new AreaDownscaler(width, height, format, cropLeft, cropTop,
+                              cropRight, cropBottom, removeLetterbox);
+  }
+
+  template <typename F, typename G>
+  inline void forEachPixel(AreaDownscaler* downscaler,
+                           std::vector<bool>& changedRows,
+                           uint32_t width,
+                           uint32_t height,
+                           F action,
+                           G keepRow) {
+    // (the source can have any resolution; the last loaded frame is
+    //  averaged down to `width`x`height`)
+    downscaler->downscale(buffer, pitch, changedRows, width, height, action,
+                          keepRow);
+  }
+
+  virtual ~FrameSource() {}
+
+ protected:
+  uint8_t* buffer = NULL;
+  uint32_t width;
+  uint32_t height;
+  uint32_t pitch;  // (bytes per row)
+  SourceFormat format;  // (pixels are always 32-bit words)
+
+  virtual uint8_t* capture() = 0;
+
+ private:
+  std::vector<uint64_t> rowHashes;
+  std::vector<uint64_t> previousRowHashes;
+  bool hasHashes;
+
+  void hashRows() {
+    // (two FNV-1a lanes over the raw 32-bit words of each row: it's cheap,
+    //  and it doesn't need the pixels to be decoded)
+    rowHashes.swap(previousRowHashes);
+    hasChanged = !hasHashes;
+
+    for (uint32_t row = 0; row < height; row++) {
+      uint32_t* pixels = (uint32_t*)(buffer + row * pitch);
+      uint32_t hash1 = FRAME_SOURCE_HASH_BASIS,
+               hash2 = FRAME_SOURCE_HASH_BASIS + 1;
+      uint32_t column = 0;
+      for (; column + 1 < width; column += 2) {
+        hash1 = (hash1 ^ pixels[column]) * FRAME_SOURCE_HASH_PRIME;
+        hash2 = (hash2 ^ pixels[column + 1]) * FRAME_SOURCE_HASH_PRIME;
+      }
+      if (column < width)
+        hash1 = (hash1 ^ pixels[column]) * FRAME_SOURCE_HASH_PRIME;
+
+      rowHashes[row] = ((uint64_t)hash1 << 32) | hash2;
+      changedRows[row] = !hasHashes || rowHashes[row] != previousRowHashes[row];
+      hasChanged = hasChanged || changedRows[row];
+    }
+
+    hasHashes = true;
+  }
+};
+
+#endif  // FRAME_SOURCE_H
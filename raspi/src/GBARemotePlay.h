@@ -2,17 +2,38 @@
 #define GBA_REMOTE_PLAY_H
 
 #include "Benchmark.h"
+#include "BlockMatcher.h"
 #include "BuildConfig.h"
 #include "Config.h"
+#include "DeadlineScheduler.h"
+#include "DispmanxSource.h"
+#include "EncodedFrame.h"
+#include "FadeDetector.h"
+#include "FbdevSource.h"
 #include "Frame.h"
-#include "FrameBuffer.h"
+#include "FrameCadence.h"
+#include "FrameCommands.h"
+#include "FrameRelay.h"
 #include "ImageDiffRLECompressor.h"
+#include "LatencyProbe.h"
 #include "LoopbackAudio.h"
+#include "Metrics.h"
+#include "OrderedDither.h"
 #include "PNGWriter.h"
 #include "Palette.h"
 #include "Protocol.h"
+#include "RateController.h"
+#include "RawStreamSource.h"
+#include "ReferenceFrames.h"
 #include "ReliableStream.h"
+#include "ResolutionController.h"
+#include "ScenePalette.h"
 #include "SPIMaster.h"
+#include "ScrollDetector.h"
+#include "SharedMemorySource.h"
+#include "SourceHub.h"
+#include "TileEncoder.h"
+#include "TraceRing.h"
 #include "Utils.h"
 #include "VirtualGamepad.h"
 
@@ -24,29 +45,111 @@ uint8_t LUT_24BPP_TO_8BIT_PALETTE[PALETTE_24BIT_MAX_COLORS];
 
 class GBARemotePlay {
  public:
-  GBARemotePlay() {
-    config = new Config(CONFIG_FILENAME);
-    spiMaster = new SPIMaster(SPI_MODE, config->spiNormalTiming,
-                              config->spiOverclockedTiming);
-    reliableStream = new ReliableStream(spiMaster);
-    frameBuffer = new FrameBuffer(DRAW_WIDTH, DRAW_HEIGHT);
-    loopbackAudio = new LoopbackAudio();
-    virtualGamepad =
-        new VirtualGamepad(config->virtualGamepadName, CONTROLS_FILENAME);
+  GBARemotePlay(Config* config,
+                uint32_t stationId,
+                SourceHub* sourceHub,
+                Metrics* metrics) {
+    // (every GBA link is a station; they share the config and the source)
+    this->config = config;
+    this->metrics = metrics;
+    auto station = config->stations[stationId];
+    logPrefix = config->totalStations > 1
+                    ? "[" + std::to_string(stationId + 1) + "] "
+                    : "";
+    isRelayEncoder = config->relayMode == "encoder";
+    isRelayClient = config->relayMode == "client";
+    // (a relay encoder never talks to the GBA, and a relay client never
+    //  captures anything)
+    spiMaster = isRelayEncoder ? NULL : createSPIMaster(station.link);
+    trace = new TraceRing(
+        config->traceFile.empty() || config->totalStations == 1
+            ? config->traceFile
+            : config->traceFile + "." + std::to_string(stationId + 1),
+        stationId + 1);
+    // (keys can also arrive in the middle of a frame, in the stream replies)
+    reliableStream =
+        isRelayEncoder
+            ? NULL
+            : new ReliableStream(spiMaster, metrics, trace,
+                                 [this](uint16_t keys) { processKeys(keys); });
+    frameRelay = isRelayEncoder || isRelayClient
+                     ? new FrameRelay(config->relayAddress, isRelayEncoder)
+                     : NULL;
+    sourceView = isRelayClient
+                     ? NULL
+                     : new SourceView(sourceHub, station.cropLeft,
+                                      station.cropTop, station.cropRight,
+                                      station.cropBottom,
+                                      config->letterboxRemoval);
+    // (there's only one audio capture, so only the first GBA plays it)
+    loopbackAudio =
+        isRelayClient || stationId > 0 ? NULL : new LoopbackAudio();
+    virtualGamepad = isRelayClient ? NULL
+                                   : new VirtualGamepad(station.gamepadName,
+                                                        CONTROLS_FILENAME);
+    encodedFrame = new EncodedFrame();
+    tileEncoder = new TileEncoder();
+    referenceFrames = new ReferenceFrames();
+    rateController = new RateController(config->targetFps);
+    deadlineScheduler = new DeadlineScheduler();
+    resolutionController = new ResolutionController();
+    orderedDither = new OrderedDither();
+    orderedDither->initialize(config->dithering);
+    candidateDiffs = new ImageDiffRLECompressor();
+    scenePalette = new ScenePalette(
+        config->packedPixels ? PACKED_PALETTE_COLORS : PALETTE_COLORS);
+    frameCadence = new FrameCadence();
+#ifdef WITH_LATENCY_PROBE
+    latencyProbe = new LatencyProbe(logPrefix);
+#endif
     lastFrame = Frame{0};
     renderMode = DEFAULT_RENDER_MODE;
+    nextRenderMode = DEFAULT_RENDER_MODE;
+    nextField = 0;
+    isTileMode = false;
+    fadeLevel = 0;
+    isFadeWhite = false;
+    isSettled = false;
+    emptyFields = 0;
+    hasLastSource = false;
+    relayKeys = 0;
+    transferMicroseconds = 0;
+    totalFrames = 0;
+  }
 
-    PALETTE_initializeCache(PALETTE_CACHE_FILENAME);
+  static SourceHub* createSourceHub(Config* config) {
+    if (config->relayMode == "client")
+      return NULL;
+
+    FrameSource* source;
+    if (config->frameSource == "fbdev")
+      source = new FbdevSource();
+    else if (config->frameSource == "shm")
+      source = new SharedMemorySource(config->sharedMemoryName);
+    else if (config->frameSource == "raw")
+      source = new RawStreamSource(
+          config->rawSourceFile, config->rawSourceWidth,
+          config->rawSourceHeight, config->rawSourceBytesPerPixel);
+    else
+      source = new DispmanxSource();
+
+    source->initialize();
+    return new SourceHub(source);
   }
 
   void run() {
+    if (isRelayEncoder)
+      return runRelayEncoder();
+    if (isRelayClient)
+      return runRelayClient();
+
 #ifdef PROFILE
     auto startTime = PROFILE_START();
     uint32_t frames = 0;
 #endif
 
   reset:
-    syncReset();
+    applyReset(syncReset());
 
     while (true) {
 #ifdef DEBUG
@@ -55,46 +158,51 @@ class GBARemotePlay {
       std::cin >> _input;
 #endif
 
-#ifdef PROFILE_VERBOSE
-      auto frameGenerationStartTime = PROFILE_START();
-#endif
+      trace->dumpIfRequested();
+      trace->begin(TRACE_FRAME, totalFrames);
 
-      auto frame = loadFrame();
+      bool willSettle;
+      auto frame = encodeFrame(*encodedFrame, &willSettle);
 
-#ifdef PROFILE_VERBOSE
-      auto frameGenerationElapsedTime = PROFILE_END(frameGenerationStartTime);
-      auto frameDiffsStartTime = PROFILE_START();
+#ifdef WITH_LATENCY_PROBE
+      latencyProbe->onFrameEncoded(sourceView->hasChanged,
+                                   sourceView->captureTime);
 #endif
 
-      ImageDiffRLECompressor diffs;
-      diffs.initialize(frame, lastFrame, diffThreshold, renderMode);
-
 #ifdef PROFILE_VERBOSE
-      auto frameDiffsElapsedTime = PROFILE_END(frameDiffsStartTime);
       auto frameTransferStartTime = PROFILE_START();
 #endif
 
-      if (!send(frame, diffs)) {
+      if (!send(*encodedFrame)) {
+        trace->end(TRACE_FRAME, 0);
         frame.clean();
         lastFrame.clean();
         goto reset;
       }
+      rateController->measure(encodedFrame->totalPackets(),
+                              transferMicroseconds);
 
-      lastFrame.clean();
-      lastFrame = frame;
+#ifdef DEBUG_PNG
+      LOG("Writing debug PNG file...");
+      WritePNG("debug.png", frame.raw8BitPixels, frame.palette,
+               RENDER_MODE_WIDTH[renderMode], RENDER_MODE_HEIGHT[renderMode]);
+      LOG("Frame end!");
+#endif
+
+      commitFrame(frame, willSettle);
+      trace->end(TRACE_FRAME, 1);
+      totalFrames++;
 
 #ifdef PROFILE_VERBOSE
       auto frameTransferElapsedTime = PROFILE_END(frameTransferStartTime);
-      LOG("(build: " + std::to_string(frameGenerationElapsedTime) +
-          "ms, diffs: " + std::to_string(frameDiffsElapsedTime) +
-          "ms, transfer: " + std::to_string(frameTransferElapsedTime) + "ms)");
+      LOG("(transfer: " + std::to_string(frameTransferElapsedTime) + "ms)");
 #endif
 
 #ifdef PROFILE
       frames++;
       uint32_t elapsedTime = PROFILE_END(startTime);
       if (elapsedTime >= ONE_SECOND) {
-        LOG("--- " + std::to_string(frames) + " frames ---");
+        LOG(logPrefix + "--- " + std::to_string(frames) + " frames ---");
         startTime = PROFILE_START();
         frames = 0;
       }
@@ -104,36 +212,239 @@ class GBARemotePlay {
 
   ~GBARemotePlay() {
     lastFrame.clean();
-    delete config;
     delete spiMaster;
     delete reliableStream;
-    delete frameBuffer;
+    delete trace;
+    delete frameRelay;
+    delete sourceView;
     delete loopbackAudio;
     delete virtualGamepad;
+    delete tileEncoder;
+    delete referenceFrames;
+    delete rateController;
+    delete deadlineScheduler;
+    delete resolutionController;
+    delete orderedDither;
+    delete scenePalette;
+    delete candidateDiffs;
+    delete frameCadence;
+    delete encodedFrame;
+#ifdef WITH_LATENCY_PROBE
+    delete latencyProbe;
+#endif
   }
 
  private:
   Config* config;
+  Metrics* metrics;
   SPIMaster* spiMaster;
   ReliableStream* reliableStream;
-  FrameBuffer* frameBuffer;
+  TraceRing* trace;
+  FrameRelay* frameRelay;
+  SourceView* sourceView;
   LoopbackAudio* loopbackAudio;
   VirtualGamepad* virtualGamepad;
+  TileEncoder* tileEncoder;
+  ReferenceFrames* referenceFrames;
+  RateController* rateController;
+  DeadlineScheduler* deadlineScheduler;
+  ResolutionController* resolutionController;
+  OrderedDither* orderedDither;
+  ScenePalette* scenePalette;
+  ImageDiffRLECompressor* candidateDiffs;
+  FrameCadence* frameCadence;
+  EncodedFrame* encodedFrame;
+#ifdef WITH_LATENCY_PROBE
+  LatencyProbe* latencyProbe;
+#endif
+  uint16_t sourceColors[TOTAL_SCREEN_PIXELS];
+  uint8_t lastSourcePixels[TOTAL_SCREEN_PIXELS];  // (before any diff)
+  bool hasLastSource;
   Frame lastFrame;
   uint32_t renderMode;
+  uint32_t nextRenderMode;
+  int nextField;
+  bool isTileMode;
+  uint32_t fadeLevel;
+  bool isFadeWhite;
+  bool isSettled;
+  uint32_t emptyFields;
   uint32_t diffThreshold;
   uint32_t input;
+  bool isRelayEncoder;
+  bool isRelayClient;
+  uint16_t relayKeys;
+  uint32_t transferMicroseconds;
+  uint32_t totalFrames;
+  std::string logPrefix;
+
+  void runRelayEncoder() {
+    // (frames are encoded when the client asks for them, and they only
+    //  become `lastFrame` when the next request confirms they were sent)
+    frameRelay->waitForPeer();
+    Frame pendingFrame = Frame{0};
+    bool willSettle = false;
+    RelayMessage message;
+
+    while (frameRelay->receive(message)) {
+      trace->dumpIfRequested();
+      if (message.type == RELAY_MESSAGE_RESET && message.payload.size() == 1) {
+        pendingFrame.clean();
+        pendingFrame = Frame{0};
+        lastFrame.clean();
+        applyReset(message.payload[0]);
+      } else if (message.type == RELAY_MESSAGE_REQUEST &&
+                 message.payload.size() == 3) {
+        processKeys(message.payload[0]);
+        if (pendingFrame.hasData()) {
+          rateController->measure(message.payload[1], message.payload[2]);
+          commitFrame(pendingFrame, willSettle);
+          pendingFrame = Frame{0};
+        }
+
+        pendingFrame = encodeFrame(*encodedFrame, &willSettle);
+        if (!frameRelay->sendFrame(*encodedFrame))
+          break;
+      }
+    }
 
-  bool send(Frame& frame, ImageDiffRLECompressor& diffs) {
-    if (!frame.hasData())
-      return false;
+    pendingFrame.clean();
+    lastFrame.clean();
+  }
+
+  void runRelayClient() {
+    // (if the encoder goes away, the GBA is reset too, so both sides start
+    //  again from the same state)
+    frameRelay->waitForPeer();
+
+#ifdef PROFILE
+    auto startTime = PROFILE_START();
+    uint32_t frames = 0;
+#endif
+
+  reset:
+    uint32_t resetPacket = syncReset();
+    uint32_t transferredPackets = 0;
+    transferMicroseconds = 0;
+    relayKeys = 0;
+    if (!frameRelay->sendReset(resetPacket)) {
+      frameRelay->waitForPeer();
+      goto reset;
+    }
+
+    while (true) {
+      trace->dumpIfRequested();
+      if (!frameRelay->sendRequest(relayKeys, transferredPackets,
+                                   transferMicroseconds) ||
+          !frameRelay->receiveFrame(*encodedFrame)) {
+        frameRelay->waitForPeer();
+        goto reset;
+      }
+
+      if (!send(*encodedFrame))
+        goto reset;
+      transferredPackets = encodedFrame->totalPackets();
+
+#ifdef PROFILE
+      frames++;
+      uint32_t elapsedTime = PROFILE_END(startTime);
+      if (elapsedTime >= ONE_SECOND) {
+        LOG("--- " + std::to_string(frames) + " frames ---");
+        startTime = PROFILE_START();
+        frames = 0;
+      }
+#endif
+    }
+  }
+
+  Frame encodeFrame(EncodedFrame& encoded, bool* willSettle) {
+#ifdef PROFILE_VERBOSE
+    auto frameGenerationStartTime = PROFILE_START();
+#endif
+    auto buildStartTime = metrics->now();
+    trace->begin(TRACE_BUILD);
+
+    bool isDuplicate = captureFrame() && isSettled;
+    auto frame = isDuplicate ? repeatFrame() : loadFrame();
+    sourceView->release();  // (so other stations can capture)
+
+    metrics->record(HISTOGRAM_BUILD, buildStartTime);
+    trace->end(TRACE_BUILD);
+    auto diffsStartTime = metrics->now();
+    trace->begin(TRACE_DIFFS);
 
+#ifdef PROFILE_VERBOSE
+    auto frameGenerationElapsedTime = PROFILE_END(frameGenerationStartTime);
+    auto frameDiffsStartTime = PROFILE_START();
+#endif
+
+    FrameCommands commands;
+    ImageDiffRLECompressor diffs;
+    if (isDuplicate) {
+      diffs.initializeEmpty(renderMode);
+      trace->instant(TRACE_DUPLICATE);
+
+#ifdef PROFILE_VERBOSE
+      LOG("  <duplicate frame, source at " +
+          std::to_string(frameCadence->framesPerSecond()) + "fps>");
+#endif
+    } else {
+      if (config->adaptivePalette)
+        scenePalette->addCommands(commands);
+      bool isFading = fadeFrame(frame, commands);
+      if (isTileMode) {
+        stabilizeFrame(frame);
+        tileEncoder->encode(frame, diffs);
+
+#ifdef PROFILE_VERBOSE
+        LOG("  <" + std::to_string(tileEncoder->uploadedTiles) + " new tiles>");
+#endif
+      } else
+        compressFrame(frame, commands, diffs, isFading);
+    }
+
+    encodePackets(frame, commands, diffs, encoded);
+    if (diffs.shouldUseRLE())
+      metrics->add(COUNTER_RLE_SAVED_BYTES, diffs.omittedRLEPixels());
+    metrics->record(HISTOGRAM_DIFFS, diffsStartTime);
+    trace->end(TRACE_DIFFS);
+    // (once a frame sends nothing, the GBA shows exactly the source, but an
+    //  interlaced frame only compares one field, so both have to be empty)
+    bool isEmpty = !isTileMode && diffs.totalCompressedPixels == 0 &&
+                   !commands.hasCommands();
+    emptyFields = isEmpty ? emptyFields + 1 : 0;
+    *willSettle = isEmpty && (!diffs.isInterlaced() || emptyFields >= 2);
+
+#ifdef PROFILE_VERBOSE
+    auto frameDiffsElapsedTime = PROFILE_END(frameDiffsStartTime);
+    LOG("(build: " + std::to_string(frameGenerationElapsedTime) +
+        "ms, diffs: " + std::to_string(frameDiffsElapsedTime) + "ms)");
+#endif
+
+    return frame;
+  }
+
+  void commitFrame(Frame& frame, bool willSettle) {
+    lastFrame.clean();
+    lastFrame = frame;
+    isSettled = willSettle;
+    if (nextRenderMode != renderMode)
+      switchRenderMode();
+  }
+
+  bool send(EncodedFrame& encoded) {
 #ifdef PROFILE_VERBOSE
     auto idleStartTime = PROFILE_START();
 #endif
+    auto stageStartTime = metrics->now();
 
     DEBULOG("Syncing frame start...");
     TRY(reliableStream->sync(CMD_FRAME_START))
+    metrics->record(HISTOGRAM_IDLE, stageStartTime);
+
+#ifdef WITH_LATENCY_PROBE
+    latencyProbe->onFrameStart();
+#endif
 
 #ifdef PROFILE_VERBOSE
     auto idleElapsedTime = PROFILE_END(idleStartTime);
@@ -141,107 +452,202 @@ class GBARemotePlay {
     auto metadataStartTime = PROFILE_START();
 #endif
 
+    auto transferStartTime = std::chrono::high_resolution_clock::now();
+
     DEBULOG("Receiving keys and send metadata...");
-    TRY(receiveKeysAndSendMetadata(frame, diffs))
+    stageStartTime = metrics->now();
+    TRY(receiveKeysAndSendMetadata(encoded))
+    metrics->record(HISTOGRAM_METADATA, stageStartTime);
 
 #ifdef PROFILE_VERBOSE
     auto metadataElapsedTime = PROFILE_END(metadataStartTime);
     LOG("  <" + std::to_string(metadataElapsedTime) + "ms metadata>");
 #endif
 
-    if (frame.hasAudio()) {
+    if (encoded.hasAudio) {
       DEBULOG("Syncing audio...");
+      stageStartTime = metrics->now();
       TRY(reliableStream->sync(CMD_AUDIO))
 
       DEBULOG("Sending audio...");
-      TRY(sendAudio(frame))
+      TRY(reliableStream->send(encoded.audio, AUDIO_SIZE_PACKETS, CMD_AUDIO))
+      metrics->record(HISTOGRAM_AUDIO, stageStartTime);
+    }
+
+    if (encoded.totalCommandPackets > 0) {
+      DEBULOG("Syncing commands...");
+      TRY(reliableStream->sync(CMD_COMMANDS))
+
+      DEBULOG("Sending commands...");
+      TRY(reliableStream->send(encoded.commands, encoded.totalCommandPackets,
+                               CMD_COMMANDS))
     }
 
     DEBULOG("Syncing pixels...");
     TRY(reliableStream->sync(CMD_PIXELS))
 
     DEBULOG("Sending pixels...");
-    TRY(compressAndSendPixels(frame, diffs))
+    TRY(reliableStream->send(encoded.pixels, encoded.totalPixelPackets,
+                             CMD_PIXELS))
 
     DEBULOG("Syncing frame end...");
     TRY(reliableStream->sync(CMD_FRAME_END))
 
-#ifdef DEBUG_PNG
-    LOG("Writing debug PNG file...");
-    WritePNG("debug.png", frame.raw8BitPixels, MAIN_PALETTE_24BPP,
-             RENDER_MODE_WIDTH[renderMode], RENDER_MODE_HEIGHT[renderMode]);
-    LOG("Frame end!");
+#ifdef WITH_LATENCY_PROBE
+    latencyProbe->onFrameEnd();
 #endif
 
+    transferMicroseconds =
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::high_resolution_clock::now() - transferStartTime)
+            .count();
+    metrics->observe(HISTOGRAM_TRANSFER, transferMicroseconds);
+    metrics->add(COUNTER_FRAMES);
+    metrics->add(COUNTER_BYTES, encoded.totalPackets() * PACKET_SIZE);
+
     return true;
   }
 
-  void syncReset() {
+  uint32_t syncReset() {
     uint32_t resetPacket;
     while (!IS_RESET(resetPacket = spiMaster->exchange(0)))
       ;
+    if (!trace->isEmpty()) {
+      // (the events before a reset are usually the interesting ones, and the
+      //  GBA keeps waiting for the reset confirmation while they're written)
+      trace->instant(TRACE_RESET, resetPacket);
+      trace->dump();
+    }
     spiMaster->exchange(resetPacket);
+    reliableStream->forgetKeys();
+    metrics->add(COUNTER_RESETS);
 
-    renderMode = resetPacket & RENDER_MODE_BIT_MASK;
-    virtualGamepad->setCurrentConfiguration(
-        (resetPacket >> CONTROLS_BIT_OFFSET) & CONTROLS_BIT_MASK);
-    diffThreshold = DIFF_THRESHOLDS[(resetPacket >> COMPRESSION_BIT_OFFSET) &
-                                    COMPRESSION_BIT_MASK];
     spiMaster->setOverclocked((resetPacket >> CPU_OVERCLOCK_BIT_OFFSET) &
                               CPU_OVERCLOCK_BIT_MASK);
-
+    uint32_t renderMode = resetPacket & RENDER_MODE_BIT_MASK;
     if (RENDER_MODE_IS_BENCHMARK(renderMode))
       Benchmark::main(renderMode);
+
+    return resetPacket;
+  }
+
+  void applyReset(uint32_t resetPacket) {
+    renderMode = resetPacket & RENDER_MODE_BIT_MASK;
+#ifdef WITH_LATENCY_PROBE
+    latencyProbe->reset();
+#endif
+    fadeLevel = 0;
+    isSettled = false;
+    emptyFields = 0;
+    hasLastSource = false;
+    frameCadence->reset();
+    referenceFrames->reset();
+    isTileMode = renderMode == RENDER_MODE_TILES;
+    if (isTileMode) {
+      renderMode = TILE_MODE_RENDER_MODE;
+      tileEncoder->reset();
+    }
+    nextRenderMode = renderMode;
+    virtualGamepad->setCurrentConfiguration(
+        (resetPacket >> CONTROLS_BIT_OFFSET) & CONTROLS_BIT_MASK);
+    uint32_t compression =
+        (resetPacket >> COMPRESSION_BIT_OFFSET) & COMPRESSION_BIT_MASK;
+    diffThreshold = DIFF_THRESHOLDS[compression];
+    rateController->reset(compression);
+    deadlineScheduler->reset();
+    resolutionController->reset(renderMode);
+    if (config->adaptivePalette)
+      scenePalette->reset();  // (the GBA goes back to the main palette)
+  }
+
+  uint32_t countPackets(Frame& frame,
+                        FrameCommands& commands,
+                        ImageDiffRLECompressor& diffs) {
+    uint32_t diffStart = (diffs.startPixel / 8) / PACKET_SIZE;
+    uint32_t diffPackets = diffs.temporalDiffEndPacket > diffStart
+                               ? diffs.temporalDiffEndPacket - diffStart
+                               : 0;
+
+    return diffPackets + countFixedPackets(frame, commands) +
+           diffs.expectedPackets();
   }
 
-  bool receiveKeysAndSendMetadata(Frame& frame, ImageDiffRLECompressor& diffs) {
+  uint32_t countFixedPackets(Frame& frame, FrameCommands& commands) {
+    return (frame.hasAudio() ? AUDIO_SIZE_PACKETS : 0) + commands.totalPackets;
+  }
+
+  bool receiveKeysAndSendMetadata(EncodedFrame& encoded) {
   again:
-    uint32_t metadata = diffs.startPixel |
-                        (diffs.expectedPackets() << PACKS_BIT_OFFSET) |
-                        (diffs.shouldUseRLE() ? COMPR_BIT_MASK : 0) |
-                        (frame.hasAudio() ? AUDIO_BIT_MASK : 0);
-    uint32_t keys = spiMaster->exchange(metadata);
+    uint32_t keys = spiMaster->exchange(encoded.metadata);
     if (reliableStream->finishSyncIfNeeded(keys, CMD_FRAME_START))
       goto again;
-    if (spiMaster->exchange(keys) != metadata)
+    if (spiMaster->exchange(keys) != encoded.metadata)
       return false;
 
     processKeys(keys);
 
-    uint32_t diffStart = (diffs.startPixel / 8) / PACKET_SIZE;
-    spiMaster->exchange(diffs.temporalDiffEndPacket);
-    return reliableStream->send(diffs.temporalDiffs,
-                                diffs.temporalDiffEndPacket, CMD_FRAME_START,
-                                diffStart);
-  }
+#ifdef WITH_LATENCY_PROBE
+    uint32_t latencyReport = spiMaster->exchange(encoded.diffEnd);
+    latencyProbe->onReport(latencyReport);
+#else
+    spiMaster->exchange(encoded.diffEnd);
+#endif
 
-  bool sendAudio(Frame& frame) {
-    return reliableStream->send(frame.audioChunk, AUDIO_SIZE_PACKETS,
-                                CMD_AUDIO);
+    return reliableStream->send(encoded.temporalDiffs, encoded.diffEndPacket,
+                                CMD_FRAME_START, encoded.diffStartPacket);
   }
 
-  bool compressAndSendPixels(Frame& frame, ImageDiffRLECompressor& diffs) {
-    uint32_t packetsToSend[MAX_PIXELS_SIZE];
-    uint32_t size = 0;
-    compressPixels(frame, diffs, packetsToSend, &size);
+  void encodePackets(Frame& frame,
+                     FrameCommands& commands,
+                     ImageDiffRLECompressor& diffs,
+                     EncodedFrame& encoded) {
+    encoded.metadata = diffs.startPixel |
+                       (diffs.expectedPackets() << PACKS_BIT_OFFSET) |
+                       (diffs.shouldUseRLE() ? COMPR_BIT_MASK : 0) |
+                       (frame.hasAudio() ? AUDIO_BIT_MASK : 0);
+    encoded.diffEnd = diffs.temporalDiffEndPacket |
+                      (commands.totalPackets << COMMANDS_BIT_OFFSET) |
+                      (diffs.isInterlaced() ? INTERLACE_BIT_MASK : 0) |
+                      (diffs.isPacked ? PACKED_BIT_MASK : 0) |
+                      (diffs.scanOrder << SCAN_ORDER_BIT_OFFSET) |
+                      (diffs.field == 1 ? FIELD_BIT_MASK : 0);
+    encoded.diffStartPacket = (diffs.startPixel / 8) / PACKET_SIZE;
+    encoded.diffEndPacket = diffs.temporalDiffEndPacket;
+    memcpy(encoded.temporalDiffs + encoded.diffStartPacket,
+           diffs.temporalDiffs + encoded.diffStartPacket * PACKET_SIZE,
+           encoded.totalDiffPackets() * PACKET_SIZE);
+    encoded.setAudio(frame.audioChunk);
+    encoded.totalCommandPackets = commands.totalPackets;
+    memcpy(encoded.commands, commands.packets,
+           commands.totalPackets * PACKET_SIZE);
+    encoded.totalPixelPackets = 0;
+    compressPixels(frame, diffs, encoded.pixels, &encoded.totalPixelPackets);
+    trace->instant(
+        TRACE_ENCODING,
+        (diffs.shouldUseRLE() ? TRACE_ENCODING_RLE : 0) |
+            (diffs.isInterlaced() ? TRACE_ENCODING_INTERLACED : 0) |
+            (diffs.isPacked ? TRACE_ENCODING_PACKED : 0) |
+            (isTileMode ? TRACE_ENCODING_TILES : 0) |
+            (diffs.scanOrder << TRACE_ENCODING_SCAN_ORDER_OFFSET) |
+            (encoded.totalPixelPackets << TRACE_ENCODING_PACKETS_OFFSET));
 
 #ifdef DEBUG
-    if (size != diffs.expectedPackets()) {
-      LOG("[!!!] Sizes don't match (" + std::to_string(size) + " vs " +
+    if (encoded.totalPixelPackets != diffs.expectedPackets()) {
+      LOG("[!!!] Sizes don't match (" +
+          std::to_string(encoded.totalPixelPackets) + " vs " +
           std::to_string(diffs.expectedPackets()) + ")");
     }
 #endif
 
 #ifdef PROFILE_VERBOSE
-    LOG("  <" + std::to_string(size * PACKET_SIZE) + "bytes" +
+    LOG("  <" + std::to_string(encoded.totalPixelPackets * PACKET_SIZE) +
+        "bytes" +
         (diffs.shouldUseRLE()
              ? ", rle (" + std::to_string(diffs.omittedRLEPixels()) +
                    " omitted)"
              : "") +
         (frame.hasAudio() ? ", audio>" : ">"));
 #endif
-
-    return reliableStream->send(packetsToSend, size, CMD_PIXELS);
   }
 
   void compressPixels(Frame& frame,
@@ -268,12 +674,25 @@ class GBARemotePlay {
         uint8_t times = diffs.runLengthEncoding[rleIndex];
         uint8_t pixel = diffs.compressedPixels[pixelIndex];
 
-        ADD_BYTE(times)
-        ADD_BYTE(pixel)
+        if (diffs.isPacked) {
+          // (the run length goes in the high nibble, minus one)
+          uint8_t run = ((times - 1) << 4) | pixel;
+          ADD_BYTE(run)
+        } else {
+          ADD_BYTE(times)
+          ADD_BYTE(pixel)
+        }
 
         pixelIndex += times;
         rleIndex++;
       }
+    } else if (diffs.isPacked) {
+      for (int i = 0; i < diffs.totalCompressedPixels; i += 2) {
+        uint8_t pixels = diffs.compressedPixels[i];
+        if (i + 1 < diffs.totalCompressedPixels)
+          pixels |= diffs.compressedPixels[i + 1] << 4;
+        ADD_BYTE(pixels)
+      }
     } else {
       for (int i = 0; i < diffs.totalCompressedPixels; i++) {
         uint8_t pixel = diffs.compressedPixels[i];
@@ -287,34 +706,303 @@ class GBARemotePlay {
     }
   }
 
+  bool fadeFrame(Frame& frame, FrameCommands& commands) {
+    // (while fading, `lastFrame` keeps the unfaded frame that the GBA has in
+    //  VRAM, and the new frame is replaced by it so nothing else is sent)
+    FadeDetector fadeDetector;
+    if (fadeDetector.detectFade(frame, lastFrame, renderMode)) {
+      if (fadeDetector.level != fadeLevel ||
+          fadeDetector.isWhite != isFadeWhite) {
+        fadeLevel = fadeDetector.level;
+        isFadeWhite = fadeDetector.isWhite;
+        commands.addFade(fadeLevel, isFadeWhite);
+      }
+      memcpy(frame.raw8BitPixels, lastFrame.raw8BitPixels, frame.totalPixels);
+
+#ifdef PROFILE_VERBOSE
+      LOG("  <fade " + std::to_string(fadeLevel) +
+          (isFadeWhite ? " white>" : " black>"));
+#endif
+
+      return true;
+    }
+
+    if (fadeLevel > 0) {
+      fadeLevel = 0;
+      commands.addFade(0, false);
+    }
+
+    return false;
+  }
+
+  void compressFrame(Frame& frame,
+                     FrameCommands& commands,
+                     ImageDiffRLECompressor& diffs,
+                     bool isFading) {
+    if (!isFading)
+      predictFrame(frame, commands);
+    diffThreshold = rateController->selectThreshold(frame, lastFrame,
+                                                    renderMode, isInterlaced());
+
+#ifdef PROFILE_VERBOSE
+    if (rateController->isEnabled())
+      LOG("  <compression " + std::to_string(rateController->level) + ">");
+#endif
+
+    int field = -1;
+    if (isInterlaced()) {
+      field = nextField;
+      nextField = 1 - nextField;
+    }
+
+    diffs.initialize(frame, lastFrame, diffThreshold, renderMode, field,
+                     config->packedPixels);
+    if (config->scanOrders && diffs.shouldUseRLE())
+      selectScanOrder(frame, commands, diffs);
+    uint32_t framePackets = countPackets(frame, commands, diffs);
+
+    if (config->dynamicResolution && lastFrame.hasData() &&
+        !commands.isFull()) {
+      nextRenderMode = resolutionController->update(
+          renderMode, framePackets, rateController->packetBudget());
+      if (nextRenderMode != renderMode)
+        commands.addSetRenderMode(nextRenderMode);
+    }
+
+    if (config->deadlineMode) {
+      if (deadlineScheduler->trim(frame, lastFrame, diffs,
+                                  countFixedPackets(frame, commands),
+                                  rateController->packetBudget(), renderMode))
+        diffs.initialize(frame, lastFrame, diffThreshold, renderMode, field,
+                         config->packedPixels, diffs.scanOrder);
+
+#ifdef PROFILE_VERBOSE
+      if (deadlineScheduler->postponedBlocks > 0)
+        LOG("  <" + std::to_string(deadlineScheduler->postponedBlocks) +
+            " postponed blocks>");
+#endif
+    }
+  }
+
+  void selectScanOrder(Frame& frame,
+                       FrameCommands& commands,
+                       ImageDiffRLECompressor& diffs) {
+    // (vertical structures break row runs on every pixel, so when RLE is used
+    //  the other scan orders are tried, and the smallest frame wins)
+    uint32_t bestScanOrder = SCAN_ORDER_ROWS;
+    uint32_t bestPackets = countPackets(frame, commands, diffs);
+
+    for (uint32_t scanOrder = SCAN_ORDER_ROWS + 1; scanOrder < SCAN_ORDERS;
+         scanOrder++) {
+      candidateDiffs->initialize(frame, lastFrame, diffThreshold, renderMode,
+                                 diffs.field, diffs.isPacked, scanOrder);
+      uint32_t packets = countPackets(frame, commands, *candidateDiffs);
+      if (packets < bestPackets) {
+        bestScanOrder = scanOrder;
+        bestPackets = packets;
+      }
+    }
+
+    if (bestScanOrder != SCAN_ORDER_ROWS)
+      diffs.initialize(frame, lastFrame, diffThreshold, renderMode, diffs.field,
+                       diffs.isPacked, bestScanOrder);
+
+#ifdef PROFILE_VERBOSE
+    if (bestScanOrder != SCAN_ORDER_ROWS)
+      LOG("  <scan order " + std::to_string(bestScanOrder) + ">");
+#endif
+  }
+
+  bool isInterlaced() {
+    // (the first frame after a reset is always a full one)
+    return config->interlaced && lastFrame.hasData();
+  }
+
+  void switchRenderMode() {
+    // (the GBA switches after rendering, and the next frame is a full one)
+    renderMode = nextRenderMode;
+    trace->instant(TRACE_RENDER_MODE, renderMode);
+    lastFrame.clean();
+    hasLastSource = false;
+    referenceFrames->reset();
+    deadlineScheduler->reset();
+
+#ifdef PROFILE_VERBOSE
+    LOG("  <render mode " + std::to_string(renderMode) + ">");
+#endif
+  }
+
+  void predictFrame(Frame& frame, FrameCommands& commands) {
+    // (commands mutate `lastFrame` exactly as the GBA will mutate its screen)
+    referenceFrames->storeIfNeeded(frame, lastFrame, commands, renderMode);
+
+    FadeDetector fillDetector;
+    if (fillDetector.detectFill(frame, lastFrame, renderMode)) {
+      commands.addFill(fillDetector.fillColor);
+      lastFrame.fill(fillDetector.fillColor);
+
+#ifdef PROFILE_VERBOSE
+      LOG("  <fill " + std::to_string(fillDetector.fillColor) + ">");
+#endif
+
+      return;
+    }
+
+    ScrollDetector scrollDetector;
+    if (scrollDetector.detect(frame, lastFrame, renderMode)) {
+      commands.addScroll(scrollDetector.dx, scrollDetector.dy);
+      lastFrame.scroll(scrollDetector.dx, scrollDetector.dy,
+                       RENDER_MODE_WIDTH[renderMode]);
+
+#ifdef PROFILE_VERBOSE
+      LOG("  <scroll " + std::to_string(scrollDetector.dx) + ", " +
+          std::to_string(scrollDetector.dy) + ">");
+#endif
+    }
+
+    BlockMatcher blockMatcher;
+    blockMatcher.findCopies(frame, lastFrame, commands, renderMode);
+
+#ifdef PROFILE_VERBOSE
+    if (blockMatcher.copiedBlocks > 0)
+      LOG("  <" + std::to_string(blockMatcher.copiedBlocks) + " block copies>");
+#endif
+
+    referenceFrames->findRestores(frame, lastFrame, commands, renderMode);
+
+#ifdef PROFILE_VERBOSE
+    if (referenceFrames->storedSlot > -1)
+      LOG("  <stored reference " + std::to_string(referenceFrames->storedSlot) +
+          ">");
+    if (referenceFrames->restoredBlocks > 0)
+      LOG("  <" + std::to_string(referenceFrames->restoredBlocks) +
+          " restored blocks>");
+#endif
+  }
+
+  void stabilizeFrame(Frame& frame) {
+    // (pixels under the diff threshold keep their previous value)
+    if (!lastFrame.hasData())
+      return;
+
+    for (int i = 0; i < frame.totalPixels; i++)
+      frame.hasPixelChanged(i, lastFrame, diffThreshold);
+  }
+
+  SPIMaster* createSPIMaster(std::string link) {
+    // ("spi0"/"spi1" are the chip selects of the SPI bus)
+    bool isSimulated = link == "simulated";
+    return new SPIMaster(
+        SPI_MODE, config->spiNormalTiming, config->spiOverclockedTiming,
+        link == "spi1" ? BCM2835_SPI_CS1 : BCM2835_SPI_CS0,
+        isSimulated ? new SimulatedGBA(CMD_RESET | DEFAULT_RENDER_MODE) : NULL,
+        config->totalStations > 1);
+  }
+
+  bool captureFrame() {
+    // (repeated captures are detected before decoding any pixel, and if the
+    //  source cadence says that a new frame is due soon, it waits for it)
+    sourceView->loadFrame();
+    if (!config->duplicateDetection)
+      return false;
+
+    bool isDuplicate = frameCadence->isDuplicate(sourceView->hasChanged);
+    uint32_t wait;
+    while (isDuplicate &&
+           (wait = frameCadence->expectedWaitMicroseconds()) > 0) {
+      usleep(std::min(wait, (uint32_t)CADENCE_POLL_US));
+      sourceView->loadFrame();
+      isDuplicate = frameCadence->isDuplicate(sourceView->hasChanged);
+    }
+
+    return isDuplicate;
+  }
+
+  Frame repeatFrame() {
+    // (the source didn't change and the GBA already shows it, so the last
+    //  frame is reused without quantizing or diffing anything)
+    Frame frame = lastFrame;
+    frame.raw8BitPixels = (uint8_t*)malloc(frame.totalPixels);
+    memcpy(frame.raw8BitPixels, lastFrame.raw8BitPixels, frame.totalPixels);
+    frame.audioChunk = loadAudioChunk();
+
+    return frame;
+  }
+
   Frame loadFrame() {
     Frame frame;
     frame.totalPixels = RENDER_MODE_PIXELS[renderMode];
     frame.raw8BitPixels = (uint8_t*)malloc(RENDER_MODE_PIXELS[renderMode]);
-    frame.palette = MAIN_PALETTE_24BPP;
+    frame.palette =
+        config->adaptivePalette ? scenePalette->colors : MAIN_PALETTE_24BPP;
 
     uint32_t width = RENDER_MODE_WIDTH[renderMode];
-    uint32_t scaleX = RENDER_MODE_SCALEX[renderMode];
-    uint32_t scaleY = RENDER_MODE_SCALEY[renderMode];
-
-    frameBuffer->forEachPixel(
-        [&frame, &width, &scaleX, &scaleY, this](int x, int y, uint8_t r,
-                                                 uint8_t g, uint8_t b) {
-          if (x % scaleX != 0 || y % scaleY != 0)
-            return;
-          x = x / scaleX;
-          y = y / scaleY;
-
-          frame.raw8BitPixels[y * width + x] =
-              LUT_24BPP_TO_8BIT_PALETTE[(r << 0) | (g << 8) | (b << 16)];
+    uint32_t height = RENDER_MODE_HEIGHT[renderMode];
+    uint32_t keptRows = 0;
+
+    sourceView->forEachPixel(
+        width, height,
+        [&frame, &width, this](int x, int y, uint8_t r, uint8_t g, uint8_t b) {
+          uint32_t color = orderedDither->isEnabled
+                               ? orderedDither->apply(x, y, r, g, b)
+                               : (r << 0) | (g << 8) | (b << 16);
+          if (config->adaptivePalette)
+            sourceColors[y * width + x] = ScenePalette::to15bpp(
+                (color >> 0) & 0xff, (color >> 8) & 0xff, (color >> 16) & 0xff);
+          else
+            frame.raw8BitPixels[y * width + x] =
+                LUT_24BPP_TO_8BIT_PALETTE[color];
+        },
+        [&frame, &width, &keptRows, this](int y) {
+          // (with the adaptive palette, `sourceColors` still has the row)
+          if (!hasLastSource)
+            return false;
+          if (!config->adaptivePalette)
+            memcpy(frame.raw8BitPixels + y * width,
+                   lastSourcePixels + y * width, width);
+          keptRows++;
+          return true;
         });
 
-    frame.audioChunk = loopbackAudio->loadChunk();
+#ifdef PROFILE_VERBOSE
+    if (keptRows > 0)
+      LOG("  <" + std::to_string(keptRows) + " unchanged rows>");
+#endif
+
+    if (config->adaptivePalette) {
+      // (the palette is updated before quantizing, so the frame and its
+      //  palette commands always match)
+      scenePalette->update(sourceColors, frame.totalPixels);
+      for (uint32_t i = 0; i < frame.totalPixels; i++)
+        frame.raw8BitPixels[i] = scenePalette->quantize(sourceColors[i]);
+
+#ifdef PROFILE_VERBOSE
+      if (scenePalette->changedSlots > 0)
+        LOG("  <" + std::to_string(scenePalette->changedSlots) +
+            " palette colors>");
+#endif
+    } else
+      memcpy(lastSourcePixels, frame.raw8BitPixels, frame.totalPixels);
+    hasLastSource = true;
+
+    frame.audioChunk = loadAudioChunk();
 
     return frame;
   }
 
-  void processKeys(uint16_t keys) { virtualGamepad->setButtons(keys); }
+  uint8_t* loadAudioChunk() {
+    return loopbackAudio != NULL ? loopbackAudio->loadChunk() : NULL;
+  }
+
+  void processKeys(uint16_t keys) {
+#ifdef WITH_LATENCY_PROBE
+    latencyProbe->onKeys(keys);
+#endif
+    if (isRelayClient)
+      relayKeys = keys;  // (forwarded to the encoder with the next request)
+    else
+      virtualGamepad->setButtons(keys);
+  }
 };
 
 #endif  // GBA_REMOTE_PLAY_H
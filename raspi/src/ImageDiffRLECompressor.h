@@ -2,6 +2,7 @@
 #define IMAGE_DIFF_RLE_COMPRESSOR_H
 
 #include <stdint.h>
+#include <string.h>
 #include "Frame.h"
 #include "Protocol.h"
 
@@ -14,25 +15,65 @@ typedef struct {
   uint32_t repeatedPixels;
   uint32_t startPixel;
   int lastChangedPixelId = -1;
+  int field = -1;  // (0 = even rows, 1 = odd rows, -1 = all rows)
+  bool isPacked = false;  // (4bpp: two pixels or one run per byte)
+  uint32_t scanOrder = SCAN_ORDER_ROWS;
+  uint32_t width;
+  uint32_t height;  // (of the field, in interlaced frames)
 
   void initialize(Frame currentFrame,
                   Frame previousFrame,
                   uint32_t diffThreshold,
-                  uint32_t renderMode) {
-    uint32_t totalPixels = RENDER_MODE_PIXELS[renderMode];
+                  uint32_t renderMode,
+                  int field = -1,
+                  bool isPacked = false,
+                  uint32_t scanOrder = SCAN_ORDER_ROWS) {
+    // (in interlaced frames, only the rows of one field are compared, and the
+    //  other field keeps the previous values => it stays dirty)
+    this->field = field;
+    this->isPacked = isPacked;
+    this->scanOrder = scanOrder;
+    uint32_t maxRLE = isPacked ? PACKED_MAX_RLE : MAX_RLE;
+    width = RENDER_MODE_WIDTH[renderMode];
+    height = RENDER_MODE_HEIGHT[renderMode] / (isInterlaced() ? 2 : 1);
+    uint32_t totalPixels =
+        RENDER_MODE_PIXELS[renderMode] / (isInterlaced() ? 2 : 1);
     uint32_t rleIndex = 0;
 
     totalCompressedPixels = repeatedPixels = 0;
+    lastChangedPixelId = -1;
     startPixel = totalPixels;
     temporalDiffEndPacket = TEMPORAL_DIFF_MAX_PACKETS(totalPixels);
+    if (isInterlaced())
+      keepOtherField(currentFrame, previousFrame, renderMode);
+
+    // (in row order, rows that are byte-identical to the previous frame are
+    //  marked as unchanged without comparing colors)
+    bool canSkipRows = scanOrder == SCAN_ORDER_ROWS && previousFrame.hasData();
+    uint32_t nextRowStart = 0, row = isInterlaced() ? field : 0;
 
     for (int i = 0; i < totalPixels; i++) {
-      if (currentFrame.hasPixelChanged(i, previousFrame, diffThreshold)) {
+      if (canSkipRows && i == nextRowStart) {
+        nextRowStart += width;
+        uint32_t offset = row * width;
+        row += isInterlaced() ? 2 : 1;
+        if (memcmp(currentFrame.raw8BitPixels + offset,
+                   previousFrame.raw8BitPixels + offset, width) == 0) {
+          for (uint32_t j = i; j < nextRowStart; j++)
+            setBit(temporalDiffs, j, false);
+          i = nextRowStart - 1;
+          continue;
+        }
+      }
+
+      uint32_t pixelId = toPixelId(i);
+
+      if (currentFrame.hasPixelChanged(pixelId, previousFrame, diffThreshold)) {
         // (a pixel changed)
         if (totalCompressedPixels > 0) {
-          if (currentFrame.raw8BitPixels[lastChangedPixelId] !=
-                  currentFrame.raw8BitPixels[i] ||
-              runLengthEncoding[rleIndex] == MAX_RLE) {
+          if (compressedPixels[totalCompressedPixels - 1] !=
+                  currentFrame.raw8BitPixels[pixelId] ||
+              runLengthEncoding[rleIndex] == maxRLE) {
             // (the pixel has a new color)
             rleIndex++;
             runLengthEncoding[rleIndex] = 1;
@@ -48,7 +89,8 @@ typedef struct {
         }
 
         setBit(temporalDiffs, i, true);
-        compressedPixels[totalCompressedPixels] = currentFrame.raw8BitPixels[i];
+        compressedPixels[totalCompressedPixels] =
+            currentFrame.raw8BitPixels[pixelId];
         totalCompressedPixels++;
         lastChangedPixelId = i;
       } else {
@@ -63,14 +105,40 @@ typedef struct {
     }
   }
 
+  void initializeEmpty(uint32_t renderMode) {
+    // (no pixel changed, so no temporal diff packets are sent either)
+    field = -1;
+    isPacked = false;
+    scanOrder = SCAN_ORDER_ROWS;
+    width = RENDER_MODE_WIDTH[renderMode];
+    height = RENDER_MODE_HEIGHT[renderMode];
+    totalCompressedPixels = repeatedPixels = 0;
+    lastChangedPixelId = -1;
+    startPixel = RENDER_MODE_PIXELS[renderMode];
+    temporalDiffEndPacket = TEMPORAL_DIFF_MAX_PACKETS(startPixel);
+  }
+
   uint32_t expectedPackets() {
     return size() / PIXELS_PER_PACKET + ((size() % PIXELS_PER_PACKET) != 0);
   }
 
   bool hasPixelChanged(uint32_t pixelId) {
-    return getBit(temporalDiffs, pixelId);
+    if (scanOrder == SCAN_ORDER_ROWS && !isInterlaced())
+      return getBit(temporalDiffs, pixelId);
+
+    uint32_t x = pixelId % width;
+    uint32_t y = pixelId / width;
+    if (isInterlaced()) {
+      if (y % 2 != field)
+        return false;
+      y /= 2;
+    }
+
+    return getBit(temporalDiffs, toScanIndex(x, y));
   }
 
+  bool isInterlaced() { return field > -1; }
+
   uint32_t totalEncodedPixels() {
     return totalCompressedPixels - repeatedPixels;
   }
@@ -80,8 +148,68 @@ typedef struct {
   uint32_t size() { return shouldUseRLE() ? sizeWithRLE() : sizeWithoutRLE(); }
 
  private:
-  uint32_t sizeWithRLE() { return totalEncodedPixels() * 2; }
-  uint32_t sizeWithoutRLE() { return totalCompressedPixels; }
+  uint32_t sizeWithRLE() {
+    return isPacked ? totalEncodedPixels() : totalEncodedPixels() * 2;
+  }
+  uint32_t sizeWithoutRLE() {
+    return isPacked ? (totalCompressedPixels + 1) / 2 : totalCompressedPixels;
+  }
+
+  uint32_t toPixelId(uint32_t i) {
+    // (`i` walks the frame (or the field) in the selected scan order)
+    if (scanOrder == SCAN_ORDER_ROWS && !isInterlaced())
+      return i;
+
+    uint32_t x, y;
+    switch (scanOrder) {
+      case SCAN_ORDER_COLUMNS: {
+        x = i / height;
+        y = i % height;
+        break;
+      }
+      case SCAN_ORDER_BLOCKS: {
+        uint32_t block = i / (SCAN_BLOCK_SIZE * SCAN_BLOCK_SIZE);
+        uint32_t offset = i % (SCAN_BLOCK_SIZE * SCAN_BLOCK_SIZE);
+        uint32_t blocksPerRow = width / SCAN_BLOCK_SIZE;
+        x = (block % blocksPerRow) * SCAN_BLOCK_SIZE + offset % SCAN_BLOCK_SIZE;
+        y = (block / blocksPerRow) * SCAN_BLOCK_SIZE + offset / SCAN_BLOCK_SIZE;
+        break;
+      }
+      default: {
+        x = i % width;
+        y = i / width;
+        break;
+      }
+    }
+
+    return (isInterlaced() ? y * 2 + field : y) * width + x;
+  }
+
+  uint32_t toScanIndex(uint32_t x, uint32_t y) {
+    switch (scanOrder) {
+      case SCAN_ORDER_COLUMNS:
+        return x * height + y;
+      case SCAN_ORDER_BLOCKS: {
+        uint32_t blocksPerRow = width / SCAN_BLOCK_SIZE;
+        uint32_t block =
+            (y / SCAN_BLOCK_SIZE) * blocksPerRow + x / SCAN_BLOCK_SIZE;
+        return block * SCAN_BLOCK_SIZE * SCAN_BLOCK_SIZE +
+               (y % SCAN_BLOCK_SIZE) * SCAN_BLOCK_SIZE + x % SCAN_BLOCK_SIZE;
+      }
+      default:
+        return y * width + x;
+    }
+  }
+
+  void keepOtherField(Frame& currentFrame,
+                      Frame& previousFrame,
+                      uint32_t renderMode) {
+    uint32_t height = RENDER_MODE_HEIGHT[renderMode];
+
+    for (uint32_t row = 1 - field; row < height; row += 2)
+      memcpy(currentFrame.raw8BitPixels + row * width,
+             previousFrame.raw8BitPixels + row * width, width);
+  }
 
   void setBit(uint8_t* bitarray, uint32_t n, bool value) {
     uint32_t byte = n / 8;
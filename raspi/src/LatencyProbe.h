@@ -0,0 +1,204 @@
+#ifndef LATENCY_PROBE_H
+#define LATENCY_PROBE_H
+
+#include <stdint.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include "Protocol.h"
+#include "Utils.h"
+
+// Input-to-photon measurements (WITH_LATENCY_PROBE, on both sides).
+// A probe starts when a key press arrives from the GBA, and follows the first
+// source frame that changes after it, through these stages:
+// - input: key pressed => first transfer with it (measured by the GBA)
+// - capture: keys applied => changed frame captured (includes the game)
+// - encode: captured => encoded
+// - queue: encoded => GBA ready for the frame (frame start sync)
+// - wire: frame start => frame end
+// - render: frame end => rendered (measured by the GBA)
+// The first change is assumed to be caused by the input, so it's accurate
+// on static scenes (like menus). Relay modes are not measured.
+
+#define LATENCY_STAGES 6
+#define LATENCY_BUCKETS 10  // (<0.25ms, <0.5ms, <1ms, ..., <64ms, more)
+#define LATENCY_FIRST_BUCKET_US 250
+#define LATENCY_REPORT_PROBES 20
+#define LATENCY_MISSING 0xffffffff
+
+const std::string LATENCY_STAGE_NAMES[LATENCY_STAGES + 1] = {
+    "input", "capture", "encode", "queue", "wire", "render", "total"};
+
+typedef std::chrono::steady_clock::time_point LatencyTime;
+
+typedef struct {
+  uint32_t buckets[LATENCY_BUCKETS];
+  uint32_t samples;
+  uint64_t totalMicroseconds;
+  uint32_t maxMicroseconds;
+
+  void add(uint32_t microseconds) {
+    uint32_t bucket = 0;
+    uint32_t limit = LATENCY_FIRST_BUCKET_US;
+    while (bucket < LATENCY_BUCKETS - 1 && microseconds >= limit) {
+      bucket++;
+      limit *= 2;
+    }
+
+    buckets[bucket]++;
+    samples++;
+    totalMicroseconds += microseconds;
+    maxMicroseconds = std::max(maxMicroseconds, microseconds);
+  }
+
+  std::string toString() {
+    if (samples == 0)
+      return "no samples";
+
+    std::string output = "avg " + toMilliseconds(totalMicroseconds / samples) +
+                         ", max " + toMilliseconds(maxMicroseconds) + " |";
+    uint32_t limit = LATENCY_FIRST_BUCKET_US;
+    for (uint32_t i = 0; i < LATENCY_BUCKETS; i++, limit *= 2) {
+      if (buckets[i] == 0)
+        continue;
+
+      output += i < LATENCY_BUCKETS - 1 ? " <" + toMilliseconds(limit)
+                                        : " >=" + toMilliseconds(limit / 2);
+      output += ": " + std::to_string(buckets[i]);
+    }
+
+    return output;
+  }
+
+  std::string toMilliseconds(uint32_t microseconds) {
+    uint32_t hundredths = (microseconds % 1000) / 10;
+    return std::to_string(microseconds / 1000) + "." +
+           (hundredths < 10 ? "0" : "") + std::to_string(hundredths) + "ms";
+  }
+} LatencyHistogram;
+
+class LatencyProbe {
+ public:
+  LatencyProbe(std::string logPrefix) {
+    this->logPrefix = logPrefix;
+    histograms = new LatencyHistogram[LATENCY_STAGES + 1]();
+    completedProbes = 0;
+    reset();
+  }
+
+  void reset() {
+    step = STEP_IDLE;
+    lastKeys = 0;
+  }
+
+  void onKeys(uint16_t keys) {
+    bool isPress = (keys & ~lastKeys) != 0;
+    lastKeys = keys;
+    if (!isPress || step != STEP_IDLE)
+      return;
+
+    step = STEP_WAITING_FRAME;
+    pressTime = now();
+    for (auto& stage : stages)
+      stage = LATENCY_MISSING;
+  }
+
+  void onFrameEncoded(bool hasChanged, LatencyTime captureTime) {
+    if (step != STEP_WAITING_FRAME || !hasChanged || captureTime < pressTime)
+      return;
+
+    lastTime = now();
+    stages[1] = elapsed(pressTime, captureTime);
+    stages[2] = elapsed(captureTime, lastTime);
+    step = STEP_QUEUED;
+  }
+
+  void onFrameStart() {
+    if (step != STEP_QUEUED)
+      return;
+
+    auto time = now();
+    stages[3] = elapsed(lastTime, time);
+    lastTime = time;
+    step = STEP_SENDING;
+  }
+
+  void onReport(uint32_t report) {
+    // (the input part is about the press that started the probe, and the
+    //  render part is about the previous frame, so it's the probed one only
+    //  when that frame has already been sent)
+    uint32_t inputTicks = report & LATENCY_INPUT_BIT_MASK;
+    uint32_t renderTicks = report >> LATENCY_RENDER_BIT_OFFSET;
+    if (step != STEP_IDLE && stages[0] == LATENCY_MISSING &&
+        inputTicks != LATENCY_NONE)
+      stages[0] = inputTicks * LATENCY_TICK_NS / 1000;
+
+    if (step == STEP_WAITING_RENDER) {
+      stages[5] = renderTicks != LATENCY_NONE
+                      ? renderTicks * LATENCY_TICK_NS / 1000
+                      : LATENCY_MISSING;
+      finish();
+    }
+  }
+
+  void onFrameEnd() {
+    if (step != STEP_SENDING)
+      return;
+
+    stages[4] = elapsed(lastTime, now());
+    step = STEP_WAITING_RENDER;
+  }
+
+  ~LatencyProbe() { delete[] histograms; }
+
+ private:
+  enum Step {
+    STEP_IDLE,
+    STEP_WAITING_FRAME,
+    STEP_QUEUED,
+    STEP_SENDING,
+    STEP_WAITING_RENDER
+  };
+
+  std::string logPrefix;
+  LatencyHistogram* histograms;
+  uint32_t completedProbes;
+  uint32_t step;
+  uint16_t lastKeys;
+  uint32_t stages[LATENCY_STAGES];  // (microseconds)
+  LatencyTime pressTime;
+  LatencyTime lastTime;
+
+  void finish() {
+    // (stages the GBA didn't report are left out of the histograms, and out
+    //  of the total)
+    uint32_t total = 0;
+    for (uint32_t i = 0; i < LATENCY_STAGES; i++) {
+      if (stages[i] == LATENCY_MISSING)
+        continue;
+      histograms[i].add(stages[i]);
+      total += stages[i];
+    }
+    histograms[LATENCY_STAGES].add(total);
+    step = STEP_IDLE;
+
+    if (++completedProbes % LATENCY_REPORT_PROBES == 0)
+      print();
+  }
+
+  void print() {
+    LOG(logPrefix + "--- latency (" + std::to_string(completedProbes) +
+        " presses) ---");
+    for (uint32_t i = 0; i < LATENCY_STAGES + 1; i++)
+      LOG("  " + LATENCY_STAGE_NAMES[i] + ": " + histograms[i].toString());
+  }
+
+  LatencyTime now() { return std::chrono::steady_clock::now(); }
+
+  uint32_t elapsed(LatencyTime start, LatencyTime end) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(end - start)
+        .count();
+  }
+};
+
+#endif  // LATENCY_PROBE_H
@@ -0,0 +1,130 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+
+// Per-station timings and counters, always on.
+// Only the station's thread writes them (so there are no read-modify-write
+// atomics), and the stats socket reads them at any time. Values are 32-bit
+// and wrap around, so readers should use the difference between two reads.
+
+#define METRICS_BUCKETS 16  // (<16us, <32us, ..., <256ms, more)
+#define METRICS_FIRST_BUCKET_US 16
+
+enum MetricsHistogram {
+  HISTOGRAM_BUILD,
+  HISTOGRAM_DIFFS,
+  HISTOGRAM_IDLE,
+  HISTOGRAM_METADATA,
+  HISTOGRAM_AUDIO,
+  HISTOGRAM_TRANSFER,
+  METRICS_HISTOGRAMS
+};
+
+enum MetricsCounter {
+  COUNTER_FRAMES,
+  COUNTER_BYTES,
+  COUNTER_RLE_SAVED_BYTES,
+  COUNTER_RECOVERIES,
+  COUNTER_RESETS,
+  COUNTER_GARBAGE_PACKETS,
+  METRICS_COUNTERS
+};
+
+const std::string METRICS_HISTOGRAM_NAMES[METRICS_HISTOGRAMS] = {
+    "build_us",    "diffs_us", "idle_us",
+    "metadata_us", "audio_us", "transfer_us"};
+const std::string METRICS_COUNTER_NAMES[METRICS_COUNTERS] = {
+    "frames",     "bytes",  "rle_saved_bytes",
+    "recoveries", "resets", "garbage_packets"};
+
+typedef std::chrono::steady_clock::time_point MetricsTime;
+
+class Metrics {
+ public:
+  Metrics(std::string station) {
+    this->station = station;
+    for (auto& histogram : histograms) {
+      for (auto& bucket : histogram.buckets)
+        bucket = 0;
+      histogram.sum = 0;
+    }
+    for (auto& counter : counters)
+      counter = 0;
+  }
+
+  MetricsTime now() { return std::chrono::steady_clock::now(); }
+
+  void record(MetricsHistogram id, MetricsTime startTime) {
+    observe(id, std::chrono::duration_cast<std::chrono::microseconds>(
+                    now() - startTime)
+                    .count());
+  }
+
+  void observe(MetricsHistogram id, uint32_t microseconds) {
+    uint32_t bucket = 0;
+    uint32_t limit = METRICS_FIRST_BUCKET_US;
+    while (bucket < METRICS_BUCKETS - 1 && microseconds >= limit) {
+      bucket++;
+      limit *= 2;
+    }
+
+    increase(histograms[id].buckets[bucket], 1);
+    increase(histograms[id].sum, microseconds);
+  }
+
+  void add(MetricsCounter id, uint32_t value = 1) {
+    increase(counters[id], value);
+  }
+
+  std::string toText() {
+    // (Prometheus' text format: histograms have cumulative buckets)
+    std::string label = "station=\"" + station + "\"";
+    std::string output;
+
+    for (uint32_t i = 0; i < METRICS_COUNTERS; i++)
+      output += METRICS_COUNTER_NAMES[i] + "{" + label + "} " +
+                std::to_string(read(counters[i])) + "\n";
+
+    for (uint32_t i = 0; i < METRICS_HISTOGRAMS; i++) {
+      auto& name = METRICS_HISTOGRAM_NAMES[i];
+      uint32_t count = 0;
+      uint32_t limit = METRICS_FIRST_BUCKET_US;
+      for (uint32_t j = 0; j < METRICS_BUCKETS; j++, limit *= 2) {
+        count += read(histograms[i].buckets[j]);
+        std::string bound =
+            j < METRICS_BUCKETS - 1 ? std::to_string(limit) : "+Inf";
+        output += name + "_bucket{" + label + ",le=\"" + bound + "\"} " +
+                  std::to_string(count) + "\n";
+      }
+      output += name + "_sum{" + label + "} " +
+                std::to_string(read(histograms[i].sum)) + "\n";
+      output += name + "_count{" + label + "} " + std::to_string(count) + "\n";
+    }
+
+    return output;
+  }
+
+ private:
+  struct {
+    std::atomic<uint32_t> buckets[METRICS_BUCKETS];
+    std::atomic<uint32_t> sum;
+  } histograms[METRICS_HISTOGRAMS];
+  std::atomic<uint32_t> counters[METRICS_COUNTERS];
+  std::string station;
+
+  void increase(std::atomic<uint32_t>& value, uint32_t amount) {
+    // (single writer: a plain load and store is enough)
+    value.store(value.load(std::memory_order_relaxed) + amount,
+                std::memory_order_relaxed);
+  }
+
+  uint32_t read(std::atomic<uint32_t>& value) {
+    return value.load(std::memory_order_relaxed);
+  }
+};
+
+#endif  // METRICS_H
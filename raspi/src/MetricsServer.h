@@ -0,0 +1,97 @@
+#ifndef METRICS_SERVER_H
+#define METRICS_SERVER_H
+
+#include <stdint.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Metrics.h"
+#include "Utils.h"
+
+// Serves the metrics of every station over a Unix socket (METRICS_SOCKET):
+// each connection receives a text snapshot, and then it's closed.
+//   socat - UNIX-CONNECT:/tmp/gba-remote-play.sock
+
+class MetricsServer {
+ public:
+  MetricsServer(std::string path, uint32_t totalStations) {
+    this->path = path;
+    listenSocket = -1;
+    for (uint32_t i = 0; i < totalStations; i++)
+      stations.push_back(new Metrics(std::to_string(i + 1)));
+
+    if (path.empty())
+      return;
+
+    startListening();
+    std::thread([this]() { serve(); }).detach();
+  }
+
+  Metrics* station(uint32_t stationId) { return stations[stationId]; }
+
+  ~MetricsServer() {
+    // (the serving thread is detached, so the socket is only closed here when
+    //  the program ends)
+    if (listenSocket >= 0) {
+      shutdown(listenSocket, SHUT_RDWR);
+      unlink(path.c_str());
+    }
+  }
+
+ private:
+  std::string path;
+  int listenSocket;
+  std::vector<Metrics*> stations;
+
+  void serve() {
+    while (true) {
+      int clientSocket = accept(listenSocket, NULL, NULL);
+      if (clientSocket < 0)
+        return;
+
+      std::string text = "# gba-remote-play metrics\n";
+      for (auto& metrics : stations)
+        text += metrics->toText();
+
+      const char* data = text.c_str();
+      uint32_t size = text.size();
+      while (size > 0) {
+        ssize_t written = send(clientSocket, data, size, MSG_NOSIGNAL);
+        if (written <= 0)
+          break;
+        data += written;
+        size -= written;
+      }
+      close(clientSocket);
+    }
+  }
+
+  void startListening() {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path))
+      exitWithError();
+    strcpy(address.sun_path, path.c_str());
+
+    unlink(path.c_str());
+    listenSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenSocket < 0 ||
+        bind(listenSocket, (struct sockaddr*)&address, sizeof(address)) < 0 ||
+        listen(listenSocket, 4) < 0)
+      exitWithError();
+    LOG("Metrics available on " + path);
+  }
+
+  void exitWithError() {
+    std::cout << "Error (MetricsServer): cannot listen on " + path + "\n";
+    exit(81);
+  }
+};
+
+#endif  // METRICS_SERVER_H
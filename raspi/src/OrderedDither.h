@@ -0,0 +1,53 @@
+#ifndef ORDERED_DITHER_H
+#define ORDERED_DITHER_H
+
+#include <stdint.h>
+#include <algorithm>
+
+#define DITHER_MATRIX_SIZE 4
+#define DITHER_CELLS (DITHER_MATRIX_SIZE * DITHER_MATRIX_SIZE)
+#define DITHER_CHANNELS 3
+#define DITHER_MAX_STRENGTH 100
+
+// (4x4 Bayer matrix, values from 0 to 15)
+const uint8_t DITHER_BAYER_MATRIX[DITHER_CELLS] = {
+    0, 8, 2, 10, 12, 4, 14, 6, 3, 11, 1, 9, 15, 7, 13, 5};
+
+// (distance between two levels of each channel in the 6-8-5 palette)
+const int DITHER_CHANNEL_STEPS[DITHER_CHANNELS] = {51, 36, 64};
+
+typedef struct {
+  bool isEnabled;
+
+  void initialize(uint32_t strength) {
+    // (the offsets depend only on the pixel position, so static areas are
+    //  quantized exactly the same way in every frame and don't add diffs)
+    strength = std::min(strength, (uint32_t)DITHER_MAX_STRENGTH);
+    isEnabled = strength > 0;
+
+    for (int cell = 0; cell < DITHER_CELLS; cell++) {
+      for (int channel = 0; channel < DITHER_CHANNELS; channel++) {
+        // (offsets go from -step/2 to +step/2 at full strength)
+        int offset = ((DITHER_BAYER_MATRIX[cell] * 2 + 1 - DITHER_CELLS) *
+                      DITHER_CHANNEL_STEPS[channel] * (int)strength) /
+                     (DITHER_CELLS * 2 * DITHER_MAX_STRENGTH);
+
+        for (int value = 0; value < 256; value++)
+          ditheredValues[cell][channel][value] =
+              (uint8_t)std::min(std::max(value + offset, 0), 255);
+      }
+    }
+  }
+
+  uint32_t apply(int x, int y, uint8_t r, uint8_t g, uint8_t b) {
+    auto cell = ditheredValues[(y % DITHER_MATRIX_SIZE) * DITHER_MATRIX_SIZE +
+                        x % DITHER_MATRIX_SIZE];
+
+    return (cell[0][r] << 0) | (cell[1][g] << 8) | (cell[2][b] << 16);
+  }
+
+ private:
+  uint8_t ditheredValues[DITHER_CELLS][DITHER_CHANNELS][256];
+} OrderedDither;
+
+#endif  // ORDERED_DITHER_H
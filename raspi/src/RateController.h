@@ -0,0 +1,130 @@
+#ifndef RATE_CONTROLLER_H
+#define RATE_CONTROLLER_H
+
+#include <stdint.h>
+#include <algorithm>
+#include "Frame.h"
+#include "Protocol.h"
+#include "Utils.h"
+
+#define RATE_SAMPLE_STEP 2
+#define RATE_SMOOTHING 8  // (new link measurements weigh 1/8)
+#define RATE_CALM_FRAMES 15  // (fitting frames before lowering the level)
+#define ONE_SECOND_NS 1000000000
+
+class RateController {
+ public:
+  uint32_t level;
+
+  RateController(uint32_t targetFps) {
+    frameBudget = targetFps > 0 ? ONE_SECOND_NS / targetFps : 0;
+    reset(0);
+  }
+
+  bool isEnabled() { return frameBudget > 0; }
+
+  uint32_t packetBudget() {
+    return nanosecondsPerPacket > 0 ? frameBudget / nanosecondsPerPacket : 0;
+  }
+
+  void reset(uint32_t initialLevel) {
+    // (the level picked in the menu is a floor: it's never lowered below it)
+    level = minimumLevel = initialLevel;
+    calmFrames = 0;
+    nanosecondsPerPacket = 0;
+  }
+
+  uint32_t selectThreshold(Frame currentFrame,
+                           Frame previousFrame,
+                           uint32_t renderMode,
+                           bool isInterlaced) {
+    // (estimates the packets of every compression level using sampled pixels,
+    //  and picks the lowest level that fits in the frame budget)
+    if (!isEnabled() || nanosecondsPerPacket == 0 || !previousFrame.hasData())
+      return DIFF_THRESHOLDS[level];
+
+    uint32_t changedSamples[COMPRESSION_LEVELS] = {0};
+    uint32_t firstChangedPixel[COMPRESSION_LEVELS];
+    uint32_t lastChangedPixel[COMPRESSION_LEVELS] = {0};
+    int width = RENDER_MODE_WIDTH[renderMode];
+    int height = RENDER_MODE_HEIGHT[renderMode];
+
+    for (int y = 0; y < height; y += RATE_SAMPLE_STEP) {
+      for (int x = 0; x < width; x += RATE_SAMPLE_STEP) {
+        uint32_t pixelId = y * width + x;
+        if (currentFrame.raw8BitPixels[pixelId] ==
+            previousFrame.raw8BitPixels[pixelId])
+          continue;
+
+        uint32_t color = previousFrame.getColorOf(pixelId);
+        uint32_t distanceSquared = getDistanceSquared(
+            (color >> 0) & 0xff, (color >> 8) & 0xff, (color >> 16) & 0xff,
+            currentFrame.getColorOf(pixelId));
+        for (int i = 0; i < COMPRESSION_LEVELS; i++) {
+          if (distanceSquared <= DIFF_THRESHOLDS[i])
+            break;
+
+          if (changedSamples[i] == 0)
+            firstChangedPixel[i] = pixelId;
+          lastChangedPixel[i] = pixelId;
+          changedSamples[i]++;
+        }
+      }
+    }
+
+    uint32_t targetLevel = COMPRESSION_LEVELS - 1;
+    for (int i = minimumLevel; i < COMPRESSION_LEVELS; i++) {
+      // (the temporal diff is trimmed to the first and last changed pixels)
+      uint32_t changedPixels =
+          changedSamples[i] * RATE_SAMPLE_STEP * RATE_SAMPLE_STEP;
+      uint32_t diffPackets =
+          changedSamples[i] > 0 ? (lastChangedPixel[i] / 8) / PACKET_SIZE -
+                                      (firstChangedPixel[i] / 8) / PACKET_SIZE +
+                                      1
+                                : 0;
+      uint32_t packets = diffPackets + changedPixels / PIXELS_PER_PACKET;
+      if (isInterlaced)
+        packets /= 2;  // (only one field is sent)
+      if ((uint64_t)packets * nanosecondsPerPacket <= frameBudget) {
+        targetLevel = i;
+        break;
+      }
+    }
+
+    // (busy scenes raise the level right away, but it only goes down one
+    //  step after a few frames that fit, to avoid pumping)
+    if (targetLevel > level) {
+      level = targetLevel;
+      calmFrames = 0;
+    } else if (targetLevel < level && ++calmFrames >= RATE_CALM_FRAMES) {
+      level--;
+      calmFrames = 0;
+    } else if (targetLevel == level)
+      calmFrames = 0;
+
+    return DIFF_THRESHOLDS[level];
+  }
+
+  void measure(uint32_t packets, uint32_t elapsedMicroseconds) {
+    if (packets == 0)
+      return;
+
+    // (stalls, like the ones across resets, are clamped to one second)
+    int64_t sample = std::min(
+        std::max((uint64_t)elapsedMicroseconds * 1000 / packets, (uint64_t)1),
+        (uint64_t)ONE_SECOND_NS);
+    nanosecondsPerPacket =
+        nanosecondsPerPacket == 0
+            ? sample
+            : nanosecondsPerPacket +
+                  (sample - (int64_t)nanosecondsPerPacket) / RATE_SMOOTHING;
+  }
+
+ private:
+  uint32_t frameBudget;
+  uint32_t minimumLevel;
+  uint32_t calmFrames;
+  uint32_t nanosecondsPerPacket;
+};
+
+#endif  // RATE_CONTROLLER_H
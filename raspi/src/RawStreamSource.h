@@ -0,0 +1,103 @@
+#ifndef RAW_STREAM_SOURCE_H
+#define RAW_STREAM_SOURCE_H
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <iostream>
+#include <string>
+#include "FrameSource.h"
+
+#define RAW_STREAM_STDIN "-"
+#define RAW_STREAM_RGB24 3
+#define RAW_STREAM_XRGB32 4
+
+class RawStreamSource : public FrameSource {
+ public:
+  RawStreamSource(std::string fileName,
+                  uint32_t width,
+                  uint32_t height,
+                  uint32_t bytesPerPixel) {
+    // (headerless frames, one after the other, like the ones produced by
+    //  `ffmpeg -f rawvideo -pix_fmt rgb24` or `-pix_fmt bgr0`)
+    if (width == 0 || height == 0 ||
+        (bytesPerPixel != RAW_STREAM_RGB24 &&
+         bytesPerPixel != RAW_STREAM_XRGB32)) {
+      std::cout << "Error (Image): invalid raw stream format\n";
+      exit(62);
+    }
+
+    fileDescriptor = fileName == RAW_STREAM_STDIN
+                         ? STDIN_FILENO
+                         : open(fileName.c_str(), O_RDONLY);
+    if (fileDescriptor < 0) {
+      std::cout << "Error (Image): cannot open " + fileName + "\n";
+      exit(63);
+    }
+    struct stat info;
+    isRegularFile = fstat(fileDescriptor, &info) == 0 && S_ISREG(info.st_mode);
+
+    this->width = width;
+    this->height = height;
+    this->bytesPerPixel = bytesPerPixel;
+    pitch = width * sizeof(uint32_t);
+    format = SourceFormat{16, 8, 0};
+    frameSize = width * height * bytesPerPixel;
+    input = (uint8_t*)calloc(frameSize, 1);
+    pixels = bytesPerPixel == RAW_STREAM_XRGB32
+                 ? input
+                 : (uint8_t*)calloc(width * height, sizeof(uint32_t));
+  }
+
+  ~RawStreamSource() {
+    if (pixels != input)
+      free(pixels);
+    free(input);
+    if (fileDescriptor != STDIN_FILENO)
+      close(fileDescriptor);
+  }
+
+ protected:
+  uint8_t* capture() override {
+    // (regular files are played in a loop; when a pipe is closed, the last
+    //  frame stays)
+    if (!readFrame() && isRegularFile) {
+      lseek(fileDescriptor, 0, SEEK_SET);
+      readFrame();
+    }
+
+    return pixels;
+  }
+
+ private:
+  int fileDescriptor;
+  bool isRegularFile;
+  uint32_t bytesPerPixel;
+  uint32_t frameSize;
+  uint8_t* input;
+  uint8_t* pixels;
+
+  bool readFrame() {
+    uint32_t totalRead = 0;
+    while (totalRead < frameSize) {
+      int bytes =
+          read(fileDescriptor, input + totalRead, frameSize - totalRead);
+      if (bytes <= 0)
+        return false;
+      totalRead += bytes;
+    }
+
+    if (bytesPerPixel == RAW_STREAM_RGB24) {
+      uint32_t* words = (uint32_t*)pixels;
+      for (uint32_t i = 0; i < width * height; i++)
+        words[i] = (input[i * 3] << 16) | (input[i * 3 + 1] << 8) |
+                   input[i * 3 + 2];
+    }
+
+    return true;
+  }
+};
+
+#endif  // RAW_STREAM_SOURCE_H
@@ -0,0 +1,178 @@
+#ifndef REFERENCE_FRAMES_H
+#define REFERENCE_FRAMES_H
+
+#include <stdint.h>
+#include <string.h>
+#include "BlockMatcher.h"
+#include "Frame.h"
+#include "FrameCommands.h"
+#include "Palette.h"
+#include "Protocol.h"
+
+#define REFERENCE_SAMPLE_STEP 4
+#define REFERENCE_TOGGLE_RATIO 4  // (1/4 of changed samples => screen toggle)
+#define REFERENCE_MIN_FLICKER_SAMPLES 8
+
+typedef struct {
+  uint32_t restoredBlocks;
+  int storedSlot;
+
+  void reset() {
+    for (int i = 0; i < REFERENCE_SLOTS; i++)
+      hasSlot[i] = false;
+    hasOlderScreen = false;
+    lastStoredSlot = 0;
+    wasUseful = false;
+  }
+
+  void storeIfNeeded(Frame currentFrame,
+                     Frame& previousFrame,
+                     FrameCommands& commands,
+                     uint32_t renderMode) {
+    // (`previousFrame` is what the GBA has on screen before the commands run,
+    //  and it's only stored when a future frame is likely to go back to it)
+    storedSlot = -1;
+    if (!previousFrame.hasData())
+      return;
+
+    int width = RENDER_MODE_WIDTH[renderMode];
+    int height = RENDER_MODE_HEIGHT[renderMode];
+    bool shouldStore = wasUseful || isToggling(currentFrame, previousFrame,
+                                               width, height) ||
+                       isFlickering(currentFrame, previousFrame, width, height);
+
+    memcpy(olderScreen, previousFrame.raw8BitPixels, previousFrame.totalPixels);
+    hasOlderScreen = true;
+    if (!shouldStore || commands.isFull())
+      return;
+
+    storedSlot = (lastStoredSlot + 1) % REFERENCE_SLOTS;
+    memcpy(slots[storedSlot], previousFrame.raw8BitPixels,
+           previousFrame.totalPixels);
+    hasSlot[storedSlot] = true;
+    lastStoredSlot = storedSlot;
+    commands.addStoreReference(storedSlot);
+  }
+
+  void findRestores(Frame currentFrame,
+                    Frame& previousFrame,
+                    FrameCommands& commands,
+                    uint32_t renderMode) {
+    // (restores are applied to `previousFrame` as soon as they're found)
+    restoredBlocks = 0;
+    if (!previousFrame.hasData())
+      return;
+
+    int width = RENDER_MODE_WIDTH[renderMode];
+    int height = RENDER_MODE_HEIGHT[renderMode];
+
+    for (int y = 0; y < height; y += BLOCK_SIZE) {
+      for (int x = 0; x < width; x += BLOCK_SIZE) {
+        if (commands.isFull())
+          goto end;
+
+        int blockWidth = std::min(BLOCK_SIZE, width - x);
+        int blockHeight = std::min(BLOCK_SIZE, height - y);
+        uint32_t changedPixels = currentFrame.countBlockMisses(
+            previousFrame, x, y, x, y, blockHeight, blockWidth, width,
+            BLOCK_SIZE * BLOCK_SIZE);
+        if (changedPixels < BLOCK_MIN_CHANGED_PIXELS)
+          continue;
+
+        uint32_t bestMisses = changedPixels - BLOCK_COPY_COST;
+        int bestSlot = -1;
+        for (int slot = 0; slot < REFERENCE_SLOTS; slot++) {
+          // (a slot stored in this frame has the same pixels as the screen)
+          if (!hasSlot[slot] || slot == storedSlot)
+            continue;
+
+          Frame reference = slotAsFrame(slot, previousFrame);
+          uint32_t misses = currentFrame.countBlockMisses(
+              reference, x, y, x, y, blockHeight, blockWidth, width,
+              bestMisses);
+          if (misses < bestMisses) {
+            bestMisses = misses;
+            bestSlot = slot;
+          }
+        }
+
+        if (bestSlot > -1) {
+          commands.addRestoreBlock(bestSlot, x / BLOCK_SIZE, y / BLOCK_SIZE);
+          for (int row = 0; row < blockHeight; row++) {
+            uint32_t offset = (y + row) * width + x;
+            memcpy(previousFrame.raw8BitPixels + offset,
+                   slots[bestSlot] + offset, blockWidth);
+          }
+          restoredBlocks++;
+        }
+      }
+    }
+
+  end:
+    wasUseful = restoredBlocks > 0;
+  }
+
+ private:
+  uint8_t slots[REFERENCE_SLOTS][TOTAL_SCREEN_PIXELS];
+  bool hasSlot[REFERENCE_SLOTS];
+  uint32_t lastStoredSlot;
+  uint8_t olderScreen[TOTAL_SCREEN_PIXELS];
+  bool hasOlderScreen;
+  bool wasUseful;
+
+  bool isToggling(Frame& currentFrame,
+                  Frame& previousFrame,
+                  int width,
+                  int height) {
+    uint32_t totalSamples = 0, changedSamples = 0;
+
+    forEachSample(width, height, [&](uint32_t pixelId) {
+      totalSamples++;
+      if (currentFrame.raw8BitPixels[pixelId] !=
+          previousFrame.raw8BitPixels[pixelId])
+        changedSamples++;
+    });
+
+    return changedSamples >= totalSamples / REFERENCE_TOGGLE_RATIO;
+  }
+
+  bool isFlickering(Frame& currentFrame,
+                    Frame& previousFrame,
+                    int width,
+                    int height) {
+    // (pixels that changed since the last frame, but were like this before)
+    if (!hasOlderScreen)
+      return false;
+
+    uint32_t flickeringSamples = 0;
+    forEachSample(width, height, [&](uint32_t pixelId) {
+      uint8_t pixel = currentFrame.raw8BitPixels[pixelId];
+      if (pixel != previousFrame.raw8BitPixels[pixelId] &&
+          pixel == olderScreen[pixelId])
+        flickeringSamples++;
+    });
+
+    return flickeringSamples >= REFERENCE_MIN_FLICKER_SAMPLES;
+  }
+
+  template <typename F>
+  void forEachSample(int width, int height, F action) {
+    for (int y = REFERENCE_SAMPLE_STEP / 2; y < height;
+         y += REFERENCE_SAMPLE_STEP)
+      for (int x = REFERENCE_SAMPLE_STEP / 2; x < width;
+           x += REFERENCE_SAMPLE_STEP)
+        action(y * width + x);
+  }
+
+  Frame slotAsFrame(uint32_t slot, Frame& screen) {
+    // (references share the GBA's current palette)
+    Frame frame;
+    frame.totalPixels = screen.totalPixels;
+    frame.raw8BitPixels = slots[slot];
+    frame.palette = screen.palette;
+    frame.audioChunk = NULL;
+    return frame;
+  }
+} ReferenceFrames;
+
+#endif  // REFERENCE_FRAMES_H
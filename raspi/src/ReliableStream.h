@@ -2,13 +2,28 @@
 #define RELIABLE_STREAM_H
 
 #include <stdint.h>
+#include <functional>
+#include "Metrics.h"
 #include "Protocol.h"
 #include "SPIMaster.h"
+#include "TraceRing.h"
 #include "Utils.h"
 
+#define NO_REPLY_INDEX 0xffffffff
+#define NO_REPLY_SEQUENCE 0xffffffff
+
 class ReliableStream {
  public:
-  ReliableStream(SPIMaster* spiMaster) { this->spiMaster = spiMaster; }
+  ReliableStream(SPIMaster* spiMaster,
+                 Metrics* metrics,
+                 TraceRing* trace,
+                 std::function<void(uint16_t keys)> onKeys) {
+    this->spiMaster = spiMaster;
+    this->metrics = metrics;
+    this->trace = trace;
+    this->onKeys = onKeys;
+    forgetKeys();
+  }
 
   bool send(void* data,
             uint32_t totalPackets,
@@ -16,14 +31,18 @@ class ReliableStream {
             uint32_t startIndex = 0) {
     uint32_t index = startIndex;
     lastReceivedPacket = 0;
+    trace->begin(TRACE_STREAM, syncCommand);
 
     while (index < totalPackets) {
       uint32_t packetToSend = ((uint32_t*)data)[index];
       if (!sendPacket(packetToSend, &index, totalPackets, syncCommand,
-                      startIndex))
+                      startIndex)) {
+        trace->end(TRACE_STREAM, 0);
         return false;
+      }
     }
 
+    trace->end(TRACE_STREAM, totalPackets - startIndex);
     return true;
   }
 
@@ -32,14 +51,17 @@ class ReliableStream {
     uint32_t local = command + CMD_RPI_OFFSET;
     uint32_t remote = command + CMD_GBA_OFFSET;
     uint32_t confirmation;
+    trace->begin(TRACE_SYNC, command);
 
     while (true) {
       bool isOnSync = (confirmation = spiMaster->exchange(local)) == remote;
 
-      if (isOnSync)
+      if (isOnSync) {
+        trace->end(TRACE_SYNC, 1);
         return true;
-      else {
+      } else {
         if (IS_RESET(confirmation)) {
+          trace->end(TRACE_SYNC, 0);
           logReset("Reset! (sync)", local, remote);
           return false;
         }
@@ -49,6 +71,11 @@ class ReliableStream {
     }
   }
 
+  void forgetKeys() {
+    // (after a reset, the next reply is applied even if its sequence matches)
+    lastReplySequence = NO_REPLY_SEQUENCE;
+  }
+
   bool finishSyncIfNeeded(uint32_t packet, uint32_t command) {
     if (packet == command + CMD_GBA_OFFSET) {
       spiMaster->exchange(command + CMD_RPI_OFFSET);
@@ -60,7 +87,11 @@ class ReliableStream {
 
  private:
   SPIMaster* spiMaster;
+  Metrics* metrics;
+  TraceRing* trace;
+  std::function<void(uint16_t keys)> onKeys;
   uint32_t lastReceivedPacket = 0;
+  uint32_t lastReplySequence;
 
   bool sendPacket(uint32_t packet,
                   uint32_t* index,
@@ -86,9 +117,14 @@ class ReliableStream {
 
     if (requestedIndex == CMD_RECOVERY + CMD_GBA_OFFSET) {
       // (recovery command)
-      if (!sync(CMD_RECOVERY))
+      metrics->add(COUNTER_RECOVERIES);
+      trace->begin(TRACE_RECOVERY, *index);
+      if (!sync(CMD_RECOVERY)) {
+        trace->end(TRACE_RECOVERY, NO_REPLY_INDEX);
         return false;
-      requestedIndex = spiMaster->exchange(0);
+      }
+      requestedIndex = replyIndex(spiMaster->exchange(0));
+      trace->end(TRACE_RECOVERY, requestedIndex);
       if (requestedIndex >= totalPackets) {
         logReset("Reset! (recovery)", packet, *index);
         return false;
@@ -101,23 +137,44 @@ class ReliableStream {
                    std::to_string(totalPackets) + ")",
                packet, *index);
       return false;
-    } else if (requestedIndex == *index) {
+    } else if (replyIndex(requestedIndex) == *index) {
       // (on sync)
+      readKeys(requestedIndex);
       (*index)++;
       return true;
     } else {
       // (probably garbage => ignore)
+      metrics->add(COUNTER_GARBAGE_PACKETS);
       return true;
     }
   }
 
   bool unreliablySend(uint32_t packet, uint32_t* index) {
-    spiMaster->send(packet);
+    uint32_t reply = spiMaster->send(packet);
+    if (replyIndex(reply) == *index)
+      readKeys(reply);
     (*index)++;
 
     return true;
   }
 
+  uint32_t replyIndex(uint32_t reply) {
+    return IS_STREAM_REPLY(reply) ? reply & REPLY_INDEX_BIT_MASK
+                                  : NO_REPLY_INDEX;
+  }
+
+  void readKeys(uint32_t reply) {
+    // (only replies that match the sent index are trusted, so garbage from
+    //  unreliable packets can't press keys)
+    uint32_t sequence =
+        (reply >> REPLY_SEQUENCE_BIT_OFFSET) & REPLY_SEQUENCE_BIT_MASK;
+    if (sequence == lastReplySequence)
+      return;
+
+    lastReplySequence = sequence;
+    onKeys((reply >> REPLY_KEYS_BIT_OFFSET) & REPLY_KEYS_BIT_MASK);
+  }
+
   void logReset(std::string title, uint32_t sent, uint32_t expected) {
 #ifdef PROFILE_VERBOSE
     LOG(title);
@@ -0,0 +1,94 @@
+#ifndef RESOLUTION_CONTROLLER_H
+#define RESOLUTION_CONTROLLER_H
+
+#include <stdint.h>
+#include "Protocol.h"
+
+#define RESOLUTION_AXIS_LEVELS 3  // (25%, 50% and 100%, like the GBA's menu)
+#define RESOLUTION_DOWN_FRAMES 3  // (frames over budget before dropping)
+#define RESOLUTION_UP_FRAMES 30  // (calm frames before raising it again)
+#define RESOLUTION_UP_MARGIN 4  // (the bigger mode must fit in 3/4 of budget)
+
+typedef struct {
+  uint32_t maxRenderMode;
+  uint32_t busyFrames;
+  uint32_t calmFrames;
+
+  void reset(uint32_t renderMode) {
+    maxRenderMode = renderMode;
+    busyFrames = calmFrames = 0;
+  }
+
+  uint32_t update(uint32_t renderMode,
+                  uint32_t framePackets,
+                  uint32_t packetBudget) {
+    // (drops the resolution when frames don't fit in the budget, and raises
+    //  it when the frame would still fit with the extra pixels)
+    if (packetBudget == 0)
+      return renderMode;
+
+    if (framePackets > packetBudget) {
+      calmFrames = 0;
+      if (++busyFrames >= RESOLUTION_DOWN_FRAMES) {
+        busyFrames = 0;
+        return lower(renderMode);
+      }
+      return renderMode;
+    }
+    busyFrames = 0;
+
+    uint32_t higherRenderMode = higher(renderMode);
+    uint64_t higherPackets = (uint64_t)framePackets *
+                             RENDER_MODE_PIXELS[higherRenderMode] /
+                             RENDER_MODE_PIXELS[renderMode];
+    if (higherRenderMode != renderMode &&
+        higherPackets <= packetBudget - packetBudget / RESOLUTION_UP_MARGIN) {
+      if (++calmFrames >= RESOLUTION_UP_FRAMES) {
+        calmFrames = 0;
+        return higherRenderMode;
+      }
+    } else
+      calmFrames = 0;
+
+    return renderMode;
+  }
+
+ private:
+  uint32_t lower(uint32_t renderMode) {
+    // (the bigger axis goes first, so the scale stays balanced)
+    uint32_t widthIndex = renderMode / RESOLUTION_AXIS_LEVELS;
+    uint32_t heightIndex = renderMode % RESOLUTION_AXIS_LEVELS;
+
+    while (widthIndex > 0 || heightIndex > 0) {
+      if (heightIndex >= widthIndex && heightIndex > 0)
+        heightIndex--;
+      else
+        widthIndex--;
+
+      uint32_t candidate = widthIndex * RESOLUTION_AXIS_LEVELS + heightIndex;
+      if (!RENDER_MODE_IS_INVALID(candidate))
+        return candidate;
+    }
+
+    return renderMode;
+  }
+
+  uint32_t higher(uint32_t renderMode) {
+    // (walks down from the mode chosen in the menu, so both directions follow
+    //  the same steps)
+    uint32_t candidate = maxRenderMode;
+
+    while (candidate != renderMode) {
+      uint32_t next = lower(candidate);
+      if (next == renderMode)
+        return candidate;
+      if (next == candidate)
+        break;
+      candidate = next;
+    }
+
+    return renderMode;
+  }
+} ResolutionController;
+
+#endif  // RESOLUTION_CONTROLLER_H
@@ -3,11 +3,16 @@
 
 #include <stdlib.h>
 #include <iostream>
+#include <mutex>
+#include <thread>
 
 #include <byteswap.h>
+#include "SimulatedGBA.h"
 #include "bcm2835.h"
 
 #define SPI_MISO_PIN 9
+#define SPI_CE0_PIN RPI_V2_GPIO_P1_24
+#define SPI_CE1_PIN RPI_V2_GPIO_P1_26
 
 typedef struct {
   uint32_t slowFrequency;
@@ -25,32 +30,64 @@ class SPIMaster {
  public:
   bool isOverclocked = false;
 
-  SPIMaster(uint8_t mode, SPITiming normalTiming, SPITiming overclockedTiming) {
-    initialize();
-    bcm2835_spi_setDataMode(mode);
+  SPIMaster(uint8_t mode,
+            SPITiming normalTiming,
+            SPITiming overclockedTiming,
+            uint8_t chipSelect = BCM2835_SPI_CS0,
+            SimulatedGBA* simulatedGBA = NULL,
+            bool isSharedBus = false) {
+    // (GBAs on different chip selects share the bus, so their transfers are
+    //  interleaved packet by packet)
+    this->chipSelect = chipSelect;
+    this->simulatedGBA = simulatedGBA;
+    this->isSharedBus = isSharedBus;
+    cePin = chipSelect == BCM2835_SPI_CS1 ? SPI_CE1_PIN : SPI_CE0_PIN;
+    if (simulatedGBA == NULL)
+      initialize(mode);
 
     this->normalTiming = normalTiming;
     this->overclockedTiming = overclockedTiming;
   }
 
-  void send(uint32_t value) {
-    bcm2835_spi_set_speed_hz(timing().fastFrequency);
-    transfer(value);
+  uint32_t send(uint32_t value) {
+    return transfer(value, timing().fastFrequency);
   }
 
   uint32_t exchange(uint32_t value) {
-    bcm2835_spi_set_speed_hz(timing().slowFrequency);
-    return transfer(value);
+    return transfer(value, timing().slowFrequency);
   }
 
   void setOverclocked(bool isOverclocked) {
     this->isOverclocked = isOverclocked;
   }
 
-  ~SPIMaster() { bcm2835_spi_end(); }
+  ~SPIMaster() {
+    if (simulatedGBA != NULL) {
+      delete simulatedGBA;
+      return;
+    }
+
+    std::lock_guard<std::mutex> lock(busMutex());
+    if (--busUsers() == 0)
+      bcm2835_spi_end();
+  }
 
  private:
   SPITiming normalTiming, overclockedTiming;
+  uint8_t chipSelect;
+  uint8_t cePin;
+  bool isSharedBus;
+  SimulatedGBA* simulatedGBA;
+
+  static std::mutex& busMutex() {
+    static std::mutex mutex;
+    return mutex;
+  }
+
+  static uint32_t& busUsers() {
+    static uint32_t users = 0;
+    return users;
+  }
 
   SPITiming timing() {
     return isOverclocked ? overclockedTiming : normalTiming;
@@ -58,33 +95,70 @@ class SPIMaster {
 
   bool isSlaveBusy() { return bcm2835_gpio_lev(SPI_MISO_PIN); }
 
-  void initialize() {
-    if (!bcm2835_init()) {
-      std::cout << "Error (SPI): cannot initialize SPI\n";
-      exit(11);
+  void initialize(uint8_t mode) {
+    std::lock_guard<std::mutex> lock(busMutex());
+    if (busUsers()++ == 0) {
+      if (!bcm2835_init()) {
+        std::cout << "Error (SPI): cannot initialize SPI\n";
+        exit(11);
+      }
+
+      if (!bcm2835_spi_begin()) {
+        std::cout << "Error (SPI): cannot start SPI transfers\n";
+        exit(12);
+      }
+      bcm2835_spi_setDataMode(mode);
     }
 
-    if (!bcm2835_spi_begin()) {
-      std::cout << "Error (SPI): cannot start SPI transfers\n";
-      exit(12);
+    if (isSharedBus) {
+      // (the GBA's MISO is gated by its CE line, so CE is driven by hand to
+      //  be able to poll MISO before transferring)
+      bcm2835_gpio_fsel(cePin, BCM2835_GPIO_FSEL_OUTP);
+      bcm2835_gpio_write(cePin, HIGH);
     }
   }
 
-  uint32_t transfer(uint32_t value) {
+  void select(uint32_t frequency) {
+    bcm2835_spi_set_speed_hz(frequency);
+    if (isSharedBus) {
+      bcm2835_spi_chipSelect(BCM2835_SPI_CS_NONE);
+      bcm2835_gpio_write(cePin, LOW);
+    } else
+      bcm2835_spi_chipSelect(chipSelect);
+  }
+
+  void deselect() {
+    if (isSharedBus)
+      bcm2835_gpio_write(cePin, HIGH);
+  }
+
+  uint32_t transfer(uint32_t value, uint32_t frequency) {
+    if (simulatedGBA != NULL)
+      return simulatedGBA->exchange(value);
+
     union {
       uint32_t u32;
       char uc[4];
     } x;
     x.u32 = bswap_32(value);
 
+    std::unique_lock<std::mutex> lock(busMutex());
+    select(frequency);
     bcm2835_delayMicroseconds(timing().delayMicroseconds);
 
 #ifndef WITH_AUDIO
-    while (isSlaveBusy())
-      ;
+    while (isSlaveBusy()) {
+      // (a busy GBA releases the bus, so it can't stall the other stations)
+      deselect();
+      lock.unlock();
+      std::this_thread::yield();
+      lock.lock();
+      select(frequency);
+    }
 #endif
 
     bcm2835_spi_transfern(x.uc, 4);
+    deselect();
 
     return bswap_32(x.u32);
   }
@@ -0,0 +1,300 @@
+#ifndef SCENE_PALETTE_H
+#define SCENE_PALETTE_H
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include "FrameCommands.h"
+#include "Palette.h"
+#include "Protocol.h"
+
+#define SCENE_PALETTE_15BPP_COLORS 32768
+#define SCENE_PALETTE_UPDATE_FRAMES 30  // (at most 2 palette changes/second)
+#define SCENE_PALETTE_MIN_GAIN 4  // (the error has to drop at least 1/4)
+#define SCENE_PALETTE_NO_SLOT -1
+
+class ScenePalette {
+ public:
+  uint32_t colors[PALETTE_COLORS];  // (24bpp, what the GBA has right now)
+  uint32_t changedSlots;
+
+  ScenePalette(uint32_t maxColors) {
+    // (with 16 colors, every index fits in 4 bits)
+    this->maxColors = maxColors;
+    reset();
+  }
+
+  void reset() {
+    for (uint32_t i = 0; i < PALETTE_COLORS; i++) {
+      uint32_t color = MAIN_PALETTE_24BPP[i];
+      slots[i] = to15bpp((color >> 0) & 0xff, (color >> 8) & 0xff,
+                         (color >> 16) & 0xff);
+      colors[i] = to24bpp(slots[i]);
+    }
+    for (uint32_t i = 0; i < SCENE_PALETTE_15BPP_COLORS; i++)
+      lut[i] = findClosestSlot(i);
+
+    framesSinceUpdate = SCENE_PALETTE_UPDATE_FRAMES - 1;  // (adapt right away)
+    changedSlots = 0;
+    memset(pendingColors, SCENE_PALETTE_NO_SLOT, sizeof(pendingColors));
+  }
+
+  static uint16_t to15bpp(uint8_t r, uint8_t g, uint8_t b) {
+    return (r >> 3) | ((g >> 3) << 5) | ((b >> 3) << 10);
+  }
+
+  uint8_t quantize(uint16_t color) { return lut[color]; }
+
+  void update(uint16_t* sourceColors, uint32_t totalPixels) {
+    // (every few frames, a median cut palette is built from the frame's
+    //  histogram, and it replaces the current one only if it's much better)
+    changedSlots = 0;
+    if (++framesSinceUpdate < SCENE_PALETTE_UPDATE_FRAMES)
+      return;
+    framesSinceUpdate = 0;
+
+    std::vector<uint32_t> histogram(SCENE_PALETTE_15BPP_COLORS, 0);
+    for (uint32_t i = 0; i < totalPixels; i++)
+      histogram[sourceColors[i]]++;
+
+    std::vector<Entry> entries;
+    uint64_t currentError = 0;
+    for (uint32_t color = 0; color < SCENE_PALETTE_15BPP_COLORS; color++) {
+      if (histogram[color] == 0)
+        continue;
+
+      entries.push_back(Entry{(uint16_t)color, histogram[color]});
+      currentError += (uint64_t)histogram[color] *
+                      distanceSquared(color, slots[lut[color]]);
+    }
+
+    std::vector<uint16_t> newColors;
+    uint64_t newError = medianCut(entries, newColors);
+    if (newError * SCENE_PALETTE_MIN_GAIN >
+        currentError * (SCENE_PALETTE_MIN_GAIN - 1))
+      return;
+
+    assignSlots(newColors);
+  }
+
+  void addCommands(FrameCommands& commands) {
+    for (uint32_t i = 0; i < PALETTE_COLORS; i++) {
+      if (pendingColors[i] == SCENE_PALETTE_NO_SLOT)
+        continue;
+
+      commands.addSetPaletteColor(i, pendingColors[i]);
+      pendingColors[i] = SCENE_PALETTE_NO_SLOT;
+    }
+  }
+
+ private:
+  typedef struct {
+    uint16_t color;
+    uint32_t count;
+  } Entry;
+
+  typedef struct {
+    uint32_t first;
+    uint32_t last;
+    uint64_t population;
+    uint64_t score;
+    int axis;
+  } Box;
+
+  uint16_t slots[PALETTE_COLORS];  // (15bpp, like the GBA's palette RAM)
+  uint8_t lut[SCENE_PALETTE_15BPP_COLORS];
+  int32_t pendingColors[PALETTE_COLORS];
+  uint32_t maxColors;
+  uint32_t framesSinceUpdate;
+
+  uint64_t medianCut(std::vector<Entry>& entries,
+                     std::vector<uint16_t>& newColors) {
+    // (boxes are ranges of `entries`; the one with the biggest weighted
+    //  spread is split at its median along its longest axis)
+    std::vector<Box> boxes;
+    if (!entries.empty())
+      boxes.push_back(createBox(entries, 0, entries.size()));
+
+    while (boxes.size() < maxColors) {
+      int bestBox = -1;
+      for (uint32_t i = 0; i < boxes.size(); i++)
+        if (boxes[i].score > 0 &&
+            (bestBox == -1 || boxes[i].score > boxes[bestBox].score))
+          bestBox = i;
+      if (bestBox == -1)
+        break;
+
+      Box box = boxes[bestBox];
+      int axis = box.axis;
+      std::sort(entries.begin() + box.first, entries.begin() + box.last,
+                [axis](const Entry& a, const Entry& b) {
+                  return channel(a.color, axis) < channel(b.color, axis);
+                });
+
+      uint64_t accumulated = 0;
+      uint32_t median = box.first + 1;
+      for (uint32_t i = box.first; i < box.last - 1; i++) {
+        accumulated += entries[i].count;
+        median = i + 1;
+        if (accumulated >= box.population / 2)
+          break;
+      }
+
+      boxes[bestBox] = createBox(entries, box.first, median);
+      boxes.push_back(createBox(entries, median, box.last));
+    }
+
+    uint64_t error = 0;
+    for (auto& box : boxes) {
+      uint64_t sums[3] = {0};
+      for (uint32_t i = box.first; i < box.last; i++)
+        for (int axis = 0; axis < 3; axis++)
+          sums[axis] += (uint64_t)channel(entries[i].color, axis) *
+                        entries[i].count;
+
+      uint16_t average = (sums[0] / box.population) |
+                         ((sums[1] / box.population) << 5) |
+                         ((sums[2] / box.population) << 10);
+      newColors.push_back(average);
+      for (uint32_t i = box.first; i < box.last; i++)
+        error += (uint64_t)entries[i].count *
+                 distanceSquared(entries[i].color, average);
+    }
+
+    return error;
+  }
+
+  Box createBox(std::vector<Entry>& entries, uint32_t first, uint32_t last) {
+    Box box = {first, last, 0, 0, 0};
+    uint32_t min[3] = {31, 31, 31}, max[3] = {0, 0, 0};
+
+    for (uint32_t i = first; i < last; i++) {
+      box.population += entries[i].count;
+      for (int axis = 0; axis < 3; axis++) {
+        uint32_t value = channel(entries[i].color, axis);
+        min[axis] = std::min(min[axis], value);
+        max[axis] = std::max(max[axis], value);
+      }
+    }
+
+    uint32_t range = 0;
+    for (int axis = 0; axis < 3; axis++) {
+      if (max[axis] > min[axis] && max[axis] - min[axis] > range) {
+        range = max[axis] - min[axis];
+        box.axis = axis;
+      }
+    }
+    box.score = last - first > 1 ? (uint64_t)range * box.population : 0;
+
+    return box;
+  }
+
+  void assignSlots(std::vector<uint16_t>& newColors) {
+    // (colors that are already in the palette keep their slot, so pixels
+    //  using them stay unchanged; new colors take the free slot with the
+    //  closest old color, so recolored pixels change as little as possible)
+    bool isSlotTaken[PALETTE_COLORS] = {false};
+    std::vector<uint16_t> missingColors;
+
+    for (auto color : newColors) {
+      int slot = SCENE_PALETTE_NO_SLOT;
+      for (uint32_t i = 0; i < maxColors; i++) {
+        if (!isSlotTaken[i] && slots[i] == color) {
+          slot = i;
+          break;
+        }
+      }
+
+      if (slot != SCENE_PALETTE_NO_SLOT)
+        isSlotTaken[slot] = true;
+      else
+        missingColors.push_back(color);
+    }
+
+    bool isSlotChanged[PALETTE_COLORS] = {false};
+    for (auto color : missingColors) {
+      int slot = SCENE_PALETTE_NO_SLOT;
+      uint32_t minDistance = UINT32_MAX;
+      for (uint32_t i = 0; i < maxColors; i++) {
+        uint32_t distance = distanceSquared(slots[i], color);
+        if (!isSlotTaken[i] && distance < minDistance) {
+          slot = i;
+          minDistance = distance;
+        }
+      }
+      if (slot == SCENE_PALETTE_NO_SLOT)
+        break;
+
+      isSlotTaken[slot] = isSlotChanged[slot] = true;
+      slots[slot] = color;
+      colors[slot] = to24bpp(color);
+      pendingColors[slot] = color;
+      changedSlots++;
+    }
+
+    if (changedSlots > 0)
+      updateLUT(isSlotChanged);
+  }
+
+  void updateLUT(bool* isSlotChanged) {
+    // (only the entries that pointed to a changed slot need a full search;
+    //  the rest just check if a new color is closer than their current one)
+    std::vector<uint8_t> newSlots;
+    for (uint32_t i = 0; i < PALETTE_COLORS; i++)
+      if (isSlotChanged[i])
+        newSlots.push_back(i);
+
+    for (uint32_t color = 0; color < SCENE_PALETTE_15BPP_COLORS; color++) {
+      uint8_t slot = lut[color];
+      if (isSlotChanged[slot]) {
+        lut[color] = findClosestSlot(color);
+        continue;
+      }
+
+      uint32_t minDistance = distanceSquared(color, slots[slot]);
+      for (auto newSlot : newSlots) {
+        uint32_t distance = distanceSquared(color, slots[newSlot]);
+        if (distance < minDistance) {
+          lut[color] = newSlot;
+          minDistance = distance;
+        }
+      }
+    }
+  }
+
+  uint8_t findClosestSlot(uint16_t color) {
+    uint32_t minDistance = UINT32_MAX;
+    uint8_t bestSlot = 0;
+
+    for (uint32_t i = 0; i < maxColors; i++) {
+      uint32_t distance = distanceSquared(color, slots[i]);
+      if (distance < minDistance) {
+        minDistance = distance;
+        bestSlot = i;
+      }
+    }
+
+    return bestSlot;
+  }
+
+  static uint32_t channel(uint16_t color, int axis) {
+    return (color >> (axis * 5)) & 0b11111;
+  }
+
+  static uint32_t distanceSquared(uint16_t color1, uint16_t color2) {
+    int dr = (int)channel(color1, 0) - (int)channel(color2, 0);
+    int dg = (int)channel(color1, 1) - (int)channel(color2, 1);
+    int db = (int)channel(color1, 2) - (int)channel(color2, 2);
+    return dr * dr + dg * dg + db * db;
+  }
+
+  static uint32_t to24bpp(uint16_t color) {
+    uint32_t r = channel(color, 0), g = channel(color, 1),
+             b = channel(color, 2);
+    return ((r << 3) | (r >> 2)) | (((g << 3) | (g >> 2)) << 8) |
+           (((b << 3) | (b >> 2)) << 16);
+  }
+};
+
+#endif  // SCENE_PALETTE_H
@@ -0,0 +1,89 @@
+#ifndef SCROLL_DETECTOR_H
+#define SCROLL_DETECTOR_H
+
+#include <stdint.h>
+#include "Frame.h"
+#include "Protocol.h"
+
+#define SCROLL_SAMPLE_STEP 4
+#define SCROLL_STATIC_RATIO 8  // (1/8 of different samples => static frame)
+#define SCROLL_MIN_GAIN_RATIO 8  // (must match 1/8 more samples than 0,0)
+
+typedef struct {
+  int dx;
+  int dy;
+
+  bool detect(Frame currentFrame, Frame previousFrame, uint32_t renderMode) {
+    dx = dy = 0;
+    if (!previousFrame.hasData())
+      return false;
+
+    int width = RENDER_MODE_WIDTH[renderMode];
+    int height = RENDER_MODE_HEIGHT[renderMode];
+    uint32_t totalSamples =
+        (width / SCROLL_SAMPLE_STEP) * (height / SCROLL_SAMPLE_STEP);
+
+    uint32_t staticMatches = countMatches(currentFrame, previousFrame, width,
+                                          height, 0, 0, 0);
+    if (staticMatches >= totalSamples - totalSamples / SCROLL_STATIC_RATIO)
+      return false;
+
+    uint32_t bestMatches =
+        staticMatches + totalSamples / SCROLL_MIN_GAIN_RATIO;
+    int maxDistanceX = std::min(SCROLL_MAX_DISTANCE, width / 2);
+    int maxDistanceY = std::min(SCROLL_MAX_DISTANCE, height / 2);
+
+    for (int candidateY = -maxDistanceY; candidateY <= maxDistanceY;
+         candidateY++) {
+      for (int candidateX = -maxDistanceX; candidateX <= maxDistanceX;
+           candidateX++) {
+        if (candidateX == 0 && candidateY == 0)
+          continue;
+
+        uint32_t matches =
+            countMatches(currentFrame, previousFrame, width, height,
+                         candidateX, candidateY, totalSamples - bestMatches);
+        if (matches > bestMatches) {
+          bestMatches = matches;
+          dx = candidateX;
+          dy = candidateY;
+        }
+      }
+    }
+
+    return dx != 0 || dy != 0;
+  }
+
+ private:
+  uint32_t countMatches(Frame& currentFrame,
+                        Frame& previousFrame,
+                        int width,
+                        int height,
+                        int candidateX,
+                        int candidateY,
+                        uint32_t maxMisses) {
+    uint32_t matches = 0, misses = 0;
+
+    for (int y = SCROLL_SAMPLE_STEP / 2; y < height; y += SCROLL_SAMPLE_STEP) {
+      int sourceY = y - candidateY;
+      bool isRowExposed = sourceY < 0 || sourceY >= height;
+
+      for (int x = SCROLL_SAMPLE_STEP / 2; x < width;
+           x += SCROLL_SAMPLE_STEP) {
+        int sourceX = x - candidateX;
+        bool isExposed = isRowExposed || sourceX < 0 || sourceX >= width;
+
+        if (!isExposed && currentFrame.raw8BitPixels[y * width + x] ==
+                              previousFrame.raw8BitPixels[sourceY * width +
+                                                          sourceX])
+          matches++;
+        else if (maxMisses > 0 && ++misses > maxMisses)
+          return 0;
+      }
+    }
+
+    return matches;
+  }
+} ScrollDetector;
+
+#endif  // SCROLL_DETECTOR_H
@@ -0,0 +1,265 @@
+#ifndef SHARED_FRAME_RING_H
+#define SHARED_FRAME_RING_H
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include <atomic>
+#include <iostream>
+#include <string>
+
+// Shared memory layout (`shm_open` name, usually "/gba-remote-play"):
+// - a 4KB header (`SharedFrameRingHeader`)
+// - SHARED_RING_SLOTS slots of `pitch * height` bytes, each one 4KB-aligned
+// Pixels are XRGB8888 words (blue in the low byte), like the frame buffer.
+// The slots are a triple buffer: the producer draws on its own slot and then
+// swaps it with `middle`; the consumer swaps its own slot with `middle` when
+// it has the FRESH flag. Nobody ever touches the other side's slot, so frames
+// are read in place, without copies or locks. `sequence` is incremented on
+// every publish and it's also the futex word the consumer waits on.
+// The file never shrinks, so a restarted producer can't unmap pages from a
+// running consumer; the consumer checks the geometry on every acquire.
+
+#define SHARED_RING_MAGIC 0x52414247  // ("GBAR")
+#define SHARED_RING_VERSION 1
+#define SHARED_RING_SLOTS 3
+#define SHARED_RING_HEADER_SIZE 4096
+#define SHARED_RING_ALIGNMENT 4096
+#define SHARED_RING_SLOT_MASK 0b11
+#define SHARED_RING_FRESH_BIT (1 << 2)
+#define SHARED_RING_BYTES_PER_PIXEL 4
+#define SHARED_RING_RED_OFFSET 16
+#define SHARED_RING_GREEN_OFFSET 8
+#define SHARED_RING_BLUE_OFFSET 0
+#define SHARED_RING_RETRY_SECONDS 1
+#define SHARED_RING_RESTART_ATTEMPTS 1000
+#define SHARED_RING_RESTART_RETRY_US 1000
+
+typedef struct {
+  std::atomic<uint32_t> magic;  // (written last by the producer)
+  uint32_t version;
+  uint32_t width;
+  uint32_t height;
+  uint32_t pitch;  // (bytes per row)
+  uint32_t slotSize;  // (bytes between slots)
+  std::atomic<uint32_t> sequence;
+  std::atomic<uint32_t> middle;  // (slot | FRESH_BIT)
+  std::atomic<uint32_t> front;  // (the consumer's slot, for restarts)
+} SharedFrameRingHeader;
+
+class SharedFrameRing {
+ public:
+  SharedFrameRingHeader* header;
+
+  static SharedFrameRing* create(std::string name,
+                                 uint32_t width,
+                                 uint32_t height) {
+    // (producer side: creates or resets the ring)
+    uint32_t pitch = width * SHARED_RING_BYTES_PER_PIXEL;
+    uint32_t slotSize = alignUp(pitch * height);
+    uint32_t size = SHARED_RING_HEADER_SIZE + slotSize * SHARED_RING_SLOTS;
+
+    int fileDescriptor = shm_open(name.c_str(), O_RDWR | O_CREAT, 0666);
+    struct stat info;
+    if (fileDescriptor < 0 || fstat(fileDescriptor, &info) < 0 ||
+        (info.st_size < size && ftruncate(fileDescriptor, size) < 0)) {
+      std::cout << "Error (SharedFrameRing): cannot create " + name + "\n";
+      exit(51);
+    }
+
+    auto ring = new SharedFrameRing(name);
+    ring->map(fileDescriptor, size);
+    if (ring->isValid() && ring->header->width == width &&
+        ring->header->height == height && ring->findFreeSlot(&ring->back)) {
+      // (a restarted producer takes the slot that nobody else owns)
+      ring->saveGeometry();
+      return ring;
+    }
+
+    ring->header->magic.store(0);
+    ring->header->version = SHARED_RING_VERSION;
+    ring->header->width = width;
+    ring->header->height = height;
+    ring->header->pitch = pitch;
+    ring->header->slotSize = slotSize;
+    ring->header->sequence.store(0);
+    ring->header->middle.store(1);
+    ring->header->front.store(0);
+    ring->back = 2;
+    ring->header->magic.store(SHARED_RING_MAGIC, std::memory_order_release);
+    ring->saveGeometry();
+
+    return ring;
+  }
+
+  static SharedFrameRing* open(std::string name) {
+    // (consumer side: waits until a producer has created the ring)
+    auto ring = new SharedFrameRing(name);
+    ring->connect();
+    ring->back = SHARED_RING_SLOTS;  // (not a producer)
+    ring->saveGeometry();
+
+    return ring;
+  }
+
+  uint8_t* producerSlot() { return slot(back); }
+
+  void publish() {
+    // (the drawn slot becomes `middle`, and the old `middle` is reused)
+    back = header->middle.exchange(back | SHARED_RING_FRESH_BIT) &
+           SHARED_RING_SLOT_MASK;
+    header->sequence.fetch_add(1);
+    syscall(SYS_futex, &header->sequence, FUTEX_WAKE, INT32_MAX, NULL, NULL,
+            0);
+  }
+
+  uint8_t* acquire(uint32_t timeoutMicroseconds, bool* isNew) {
+    // (swaps the consumer's slot with the latest published one, waiting for
+    //  it if there isn't a new one yet, unless the timeout is 0)
+    if (!hasSameGeometry())
+      reconnect();
+
+    uint32_t sequence = header->sequence.load();
+    if (timeoutMicroseconds > 0 &&
+        !(header->middle.load() & SHARED_RING_FRESH_BIT)) {
+      struct timespec timeout;
+      timeout.tv_sec = timeoutMicroseconds / 1000000;
+      timeout.tv_nsec = (timeoutMicroseconds % 1000000) * 1000;
+      syscall(SYS_futex, &header->sequence, FUTEX_WAIT, sequence, &timeout,
+              NULL, 0);
+    }
+
+    *isNew = header->middle.load() & SHARED_RING_FRESH_BIT;
+    if (*isNew) {
+      uint32_t front = header->front.load();
+      front = header->middle.exchange(front) & SHARED_RING_SLOT_MASK;
+      header->front.store(front);
+    }
+
+    return slot(header->front.load());
+  }
+
+  ~SharedFrameRing() { unmap(); }
+
+ private:
+  std::string name;
+  int fileDescriptor = -1;
+  uint8_t* memory = NULL;
+  uint32_t size = 0;
+  uint32_t back;
+  uint32_t width, height, pitch, slotSize;  // (as seen when mapped)
+
+  SharedFrameRing(std::string name) { this->name = name; }
+
+  void map(int fileDescriptor, uint32_t size) {
+    this->fileDescriptor = fileDescriptor;
+    this->size = size;
+    memory = (uint8_t*)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                            fileDescriptor, 0);
+    if (memory == MAP_FAILED) {
+      std::cout << "Error (SharedFrameRing): cannot map shared memory\n";
+      exit(52);
+    }
+    header = (SharedFrameRingHeader*)memory;
+  }
+
+  void unmap() {
+    if (memory != NULL)
+      munmap(memory, size);
+    if (fileDescriptor >= 0)
+      close(fileDescriptor);
+    memory = NULL;
+    fileDescriptor = -1;
+  }
+
+  void connect() {
+    bool isWaiting = false;
+    while (true) {
+      int fileDescriptor = shm_open(name.c_str(), O_RDWR, 0666);
+      struct stat info;
+      if (fileDescriptor >= 0 && fstat(fileDescriptor, &info) == 0 &&
+          info.st_size >= SHARED_RING_HEADER_SIZE) {
+        map(fileDescriptor, info.st_size);
+        if (isValid())
+          return;
+        unmap();
+      } else if (fileDescriptor >= 0)
+        close(fileDescriptor);
+
+      if (!isWaiting)
+        std::cout << "Waiting for a frame producer on " + name + "...\n";
+      isWaiting = true;
+      sleep(SHARED_RING_RETRY_SECONDS);
+    }
+  }
+
+  void reconnect() {
+    // (the producer was restarted: the ring is mapped again, but the capture
+    //  pipeline was sized for the old frames, so they must match)
+    unmap();
+    connect();
+    if (!hasSameGeometry()) {
+      std::cout << "Error (SharedFrameRing): the frame size of " + name +
+                       " changed\n";
+      exit(53);
+    }
+  }
+
+  bool findFreeSlot(uint32_t* slot) {
+    // (the consumer swaps `middle` before storing `front`, so both can point
+    //  to the same slot for a moment; if that doesn't settle, the consumer
+    //  died in the middle of a swap and the ring is reset)
+    for (uint32_t i = 0; i < SHARED_RING_RESTART_ATTEMPTS; i++) {
+      uint32_t middle = header->middle.load() & SHARED_RING_SLOT_MASK;
+      uint32_t front = header->front.load();
+      if (middle < SHARED_RING_SLOTS && front < SHARED_RING_SLOTS &&
+          middle != front) {
+        *slot = 0 + 1 + 2 - middle - front;
+        return true;
+      }
+      usleep(SHARED_RING_RESTART_RETRY_US);
+    }
+
+    return false;
+  }
+
+  void saveGeometry() {
+    width = header->width;
+    height = header->height;
+    pitch = header->pitch;
+    slotSize = header->slotSize;
+  }
+
+  bool hasSameGeometry() {
+    return header->magic.load(std::memory_order_acquire) ==
+               SHARED_RING_MAGIC &&
+           header->width == width && header->height == height &&
+           header->pitch == pitch && header->slotSize == slotSize;
+  }
+
+  bool isValid() {
+    return header->magic.load(std::memory_order_acquire) ==
+               SHARED_RING_MAGIC &&
+           header->version == SHARED_RING_VERSION &&
+           SHARED_RING_HEADER_SIZE +
+                   (uint64_t)header->slotSize * SHARED_RING_SLOTS <=
+               size &&
+           (uint64_t)header->pitch * header->height <= header->slotSize;
+  }
+
+  uint8_t* slot(uint32_t index) {
+    return memory + SHARED_RING_HEADER_SIZE + index * slotSize;
+  }
+
+  static uint32_t alignUp(uint32_t size) {
+    return (size + SHARED_RING_ALIGNMENT - 1) / SHARED_RING_ALIGNMENT *
+           SHARED_RING_ALIGNMENT;
+  }
+};
+
+#endif  // SHARED_FRAME_RING_H
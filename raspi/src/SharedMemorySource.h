@@ -0,0 +1,35 @@
+#ifndef SHARED_MEMORY_SOURCE_H
+#define SHARED_MEMORY_SOURCE_H
+
+#include <string>
+#include "FrameSource.h"
+#include "SharedFrameRing.h"
+
+class SharedMemorySource : public FrameSource {
+ public:
+  SharedMemorySource(std::string name) {
+    // (frames come from another process, and they're read in place)
+    ring = SharedFrameRing::open(name);
+    width = ring->header->width;
+    height = ring->header->height;
+    pitch = ring->header->pitch;
+    format = SourceFormat{SHARED_RING_RED_OFFSET, SHARED_RING_GREEN_OFFSET,
+                          SHARED_RING_BLUE_OFFSET};
+  }
+
+  ~SharedMemorySource() { delete ring; }
+
+ protected:
+  uint8_t* capture() override {
+    // (it never waits: captures run under the source hub's exclusive lock, so
+    //  waiting would stall every station, and the frame cadence already
+    //  polls for frames that are about to arrive)
+    bool isNew;
+    return ring->acquire(0, &isNew);
+  }
+
+ private:
+  SharedFrameRing* ring;
+};
+
+#endif  // SHARED_MEMORY_SOURCE_H
@@ -0,0 +1,232 @@
+#ifndef SIMULATED_GBA_H
+#define SIMULATED_GBA_H
+
+#include <stdint.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include "BuildConfig.h"
+#include "Protocol.h"
+
+#define SIMULATED_GBA_KEYS 0  // (pressed keys: none)
+#define SIMULATED_GBA_PACKET_NS 12500  // (~2.6Mhz, plus the packet delay)
+#define SIMULATED_GBA_SYNC_TIMEOUT 1000  // (packets, like a frame on the GBA)
+#define SIMULATED_GBA_PRESS_KEY 0x0001  // (A, toggled with WITH_LATENCY_PROBE)
+#define SIMULATED_GBA_PRESS_FRAMES 30
+
+class SimulatedGBA {
+  // (plays the GBA side of the protocol, packet by packet, so a link can be
+  //  tested without hardware; it never drops packets, and each frame takes
+  //  as long as its packets would take on a real cable; with
+  //  WITH_LATENCY_PROBE, it also presses a key from time to time, and reports
+  //  presses and renders as instantaneous)
+ public:
+  uint32_t frames = 0;
+
+  SimulatedGBA(uint32_t resetPacket) {
+    this->resetPacket = resetPacket;
+    reset();
+  }
+
+  uint32_t exchange(uint32_t packet) {
+    // (like an SPI slave, the reply was prepared before the transfer)
+    uint32_t reply = nextReply;
+    transferredPackets++;
+    receive(packet);
+
+    return reply;
+  }
+
+ private:
+  enum Step {
+    STEP_RESET,
+    STEP_SYNC,
+    STEP_KEYS,
+    STEP_METADATA,
+    STEP_DIFF_END,
+    STEP_STREAM
+  };
+  enum Section {
+    SECTION_DIFFS,
+    SECTION_AUDIO,
+    SECTION_COMMANDS,
+    SECTION_PIXELS,
+    SECTION_FRAME_END
+  };
+
+  uint32_t resetPacket;
+  uint32_t nextReply;
+  uint32_t step;
+  uint32_t section;
+  uint32_t syncCommand;
+  uint32_t failedSyncs;
+  uint32_t metadata;
+  uint32_t index;
+  uint32_t end;
+  bool hasAudio;
+  uint32_t diffStart;
+  uint32_t diffEnd;
+  uint32_t commandPackets;
+  uint32_t pixelPackets;
+  uint32_t transferredPackets = 0;
+  uint16_t keys = SIMULATED_GBA_KEYS;
+  uint32_t keysSequence = 0;
+  bool hasPress = false;
+  std::chrono::steady_clock::time_point frameStartTime;
+
+  void receive(uint32_t packet) {
+    switch (step) {
+      case STEP_RESET: {
+        if (packet == resetPacket)
+          sync(CMD_FRAME_START);
+        break;
+      }
+      case STEP_SYNC: {
+        if (packet == syncCommand + CMD_RPI_OFFSET)
+          finishSync();
+        else if (++failedSyncs >= SIMULATED_GBA_SYNC_TIMEOUT)
+          reset();
+        break;
+      }
+      case STEP_KEYS: {
+        metadata = packet;
+        nextReply = metadata;
+        step = STEP_METADATA;
+        break;
+      }
+      case STEP_METADATA: {
+        if (packet != keys) {
+          reset();
+          break;
+        }
+        nextReply = latencyReport();
+        step = STEP_DIFF_END;
+        break;
+      }
+      case STEP_DIFF_END: {
+        readSizes(packet);
+        startSection(SECTION_DIFFS);
+        break;
+      }
+      case STEP_STREAM: {
+        if (++index < end)
+          nextReply = streamReply(index);
+        else
+          startSection(section + 1);
+        break;
+      }
+    }
+  }
+
+  void readSizes(uint32_t diffEndPacketAndCommands) {
+    // (the same limits as the GBA's `sendKeysAndReceiveMetadata()`)
+    pixelPackets = std::min((metadata >> PACKS_BIT_OFFSET) & PACKS_BIT_MASK,
+                            (uint32_t)MAX_PIXELS_SIZE);
+    if (diffEndPacketAndCommands & PACKED_BIT_MASK)
+      pixelPackets = std::min(pixelPackets, (uint32_t)MAX_PIXELS_SIZE / 2);
+    hasAudio = (metadata & AUDIO_BIT_MASK) != 0;
+    diffStart = ((metadata & START_BIT_MASK) / 8) / PACKET_SIZE;
+    diffEnd = diffEndPacketAndCommands & DIFF_END_BIT_MASK;
+    commandPackets = std::min(
+        (diffEndPacketAndCommands >> COMMANDS_BIT_OFFSET) & COMMANDS_BIT_MASK,
+        (uint32_t)COMMANDS_MAX_PACKETS);
+  }
+
+  void startSection(uint32_t section) {
+    this->section = section;
+
+    switch (section) {
+      case SECTION_DIFFS:
+        return startStream(diffStart, diffEnd);
+      case SECTION_AUDIO:
+        return hasAudio ? sync(CMD_AUDIO) : startSection(SECTION_COMMANDS);
+      case SECTION_COMMANDS:
+        return commandPackets > 0 ? sync(CMD_COMMANDS)
+                                  : startSection(SECTION_PIXELS);
+      case SECTION_PIXELS:
+        return sync(CMD_PIXELS);
+      default:
+        return sync(CMD_FRAME_END);
+    }
+  }
+
+  void finishSync() {
+    switch (syncCommand) {
+      case CMD_FRAME_START: {
+        frameStartTime = std::chrono::steady_clock::now();
+        transferredPackets = 0;
+        updateKeys();
+        nextReply = keys;
+        step = STEP_KEYS;
+        break;
+      }
+      case CMD_AUDIO:
+        return startStream(0, AUDIO_SIZE_PACKETS);
+      case CMD_COMMANDS:
+        return startStream(0, commandPackets);
+      case CMD_PIXELS:
+        return startStream(0, pixelPackets);
+      default: {
+        frames++;
+        std::this_thread::sleep_until(
+            frameStartTime +
+            std::chrono::nanoseconds((uint64_t)transferredPackets *
+                                     SIMULATED_GBA_PACKET_NS));
+        sync(CMD_FRAME_START);
+        break;
+      }
+    }
+  }
+
+  void startStream(uint32_t start, uint32_t end) {
+    if (start >= end)
+      return startSection(section + 1);
+
+    index = start;
+    this->end = end;
+    nextReply = streamReply(start);
+    step = STEP_STREAM;
+  }
+
+  void updateKeys() {
+    uint16_t newKeys = SIMULATED_GBA_KEYS;
+#ifdef WITH_LATENCY_PROBE
+    if ((frames / SIMULATED_GBA_PRESS_FRAMES) % 2 == 1)
+      newKeys |= SIMULATED_GBA_PRESS_KEY;
+#endif
+    if (newKeys == keys)
+      return;
+
+    hasPress = hasPress || (newKeys & ~keys) != 0;
+    keys = newKeys;
+    keysSequence = (keysSequence + 1) & REPLY_SEQUENCE_BIT_MASK;
+  }
+
+  uint32_t latencyReport() {
+#ifdef WITH_LATENCY_PROBE
+    uint32_t inputTicks = hasPress ? 0 : LATENCY_NONE;
+    hasPress = false;
+    return inputTicks;  // (render ticks: 0)
+#else
+    return LATENCY_NONE | (LATENCY_NONE << LATENCY_RENDER_BIT_OFFSET);
+#endif
+  }
+
+  uint32_t streamReply(uint32_t index) {
+    return STREAM_REPLY(index, keys, keysSequence);
+  }
+
+  void sync(uint32_t command) {
+    syncCommand = command;
+    failedSyncs = 0;
+    nextReply = command + CMD_GBA_OFFSET;
+    step = STEP_SYNC;
+  }
+
+  void reset() {
+    nextReply = resetPacket;
+    step = STEP_RESET;
+  }
+};
+
+#endif  // SIMULATED_GBA_H
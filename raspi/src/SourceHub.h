@@ -0,0 +1,156 @@
+#ifndef SOURCE_HUB_H
+#define SOURCE_HUB_H
+
+#include <stdint.h>
+#include <chrono>
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
+#include "AreaDownscaler.h"
+#include "FrameSource.h"
+
+// One frame source shared by every station (one per GBA link).
+// Captures are numbered: each row remembers the last capture that changed
+// it, so every view can tell which rows changed since *its* previous frame,
+// even if other stations captured in between. Views hold a read lock while
+// they decode pixels, and a new capture waits for them.
+
+class SourceHub {
+ public:
+  SourceHub(FrameSource* source) {
+    this->source = source;
+    generation = changeGeneration = 0;
+    rowGenerations.resize(source->changedRows.size());
+  }
+
+  uint32_t acquire(uint32_t seenGeneration) {
+    // (a view that already saw the latest capture takes a new one, and the
+    //  others reuse it, so each source frame is captured only once)
+    {
+      std::unique_lock<std::shared_timed_mutex> lock(mutex);
+      if (generation == seenGeneration)
+        capture();
+    }
+
+    mutex.lock_shared();
+    return generation;
+  }
+
+  void release() { mutex.unlock_shared(); }
+
+  bool changesSince(uint32_t seenGeneration, std::vector<bool>& changedRows) {
+    // (call it while holding the read lock)
+    for (uint32_t row = 0; row < rowGenerations.size(); row++)
+      changedRows[row] = rowGenerations[row] > seenGeneration;
+
+    return changeGeneration > seenGeneration;
+  }
+
+  AreaDownscaler* createDownscaler(uint32_t cropLeft,
+                                   uint32_t cropTop,
+                                   uint32_t cropRight,
+                                   uint32_t cropBottom,
+                                   bool removeLetterbox) {
+    return source->createDownscaler(cropLeft, cropTop, cropRight, cropBottom,
+                                    removeLetterbox);
+  }
+
+  template <typename F, typename G>
+  inline void forEachPixel(AreaDownscaler* downscaler,
+                           std::vector<bool>& changedRows,
+                           uint32_t width,
+                           uint32_t height,
+                           F action,
+                           G keepRow) {
+    source->forEachPixel(downscaler, changedRows, width, height, action,
+                         keepRow);
+  }
+
+  uint32_t totalRows() { return rowGenerations.size(); }
+
+  std::chrono::steady_clock::time_point lastCaptureTime() {
+    // (call it while holding the read lock)
+    return captureTime;
+  }
+
+  ~SourceHub() { delete source; }
+
+ private:
+  FrameSource* source;
+  std::shared_timed_mutex mutex;
+  uint32_t generation;
+  uint32_t changeGeneration;
+  std::vector<uint32_t> rowGenerations;
+  std::chrono::steady_clock::time_point captureTime;
+
+  void capture() {
+    captureTime = std::chrono::steady_clock::now();
+    source->loadFrame();
+    generation++;
+    if (source->hasChanged)
+      changeGeneration = generation;
+    for (uint32_t row = 0; row < rowGenerations.size(); row++)
+      if (source->changedRows[row])
+        rowGenerations[row] = generation;
+  }
+};
+
+class SourceView {
+  // (a station's viewport into the shared source)
+ public:
+  std::vector<bool> changedRows;  // (since the previous `loadFrame()`)
+  bool hasChanged;
+  std::chrono::steady_clock::time_point captureTime;  // (of the loaded frame)
+
+  SourceView(SourceHub* hub,
+             uint32_t cropLeft,
+             uint32_t cropTop,
+             uint32_t cropRight,
+             uint32_t cropBottom,
+             bool removeLetterbox) {
+    this->hub = hub;
+    downscaler = hub->createDownscaler(cropLeft, cropTop, cropRight,
+                                       cropBottom, removeLetterbox);
+    changedRows.resize(hub->totalRows());
+    hasChanged = false;
+    seenGeneration = 0;
+    isLocked = false;
+  }
+
+  void loadFrame() {
+    // (the frame stays locked until `release()` or the next `loadFrame()`)
+    release();
+    uint32_t generation = hub->acquire(seenGeneration);
+    isLocked = true;
+    hasChanged = hub->changesSince(seenGeneration, changedRows);
+    captureTime = hub->lastCaptureTime();
+    seenGeneration = generation;
+  }
+
+  template <typename F, typename G>
+  inline void forEachPixel(uint32_t width,
+                           uint32_t height,
+                           F action,
+                           G keepRow) {
+    hub->forEachPixel(downscaler, changedRows, width, height, action, keepRow);
+  }
+
+  void release() {
+    if (isLocked)
+      hub->release();
+    isLocked = false;
+  }
+
+  ~SourceView() {
+    release();
+    delete downscaler;
+  }
+
+ private:
+  SourceHub* hub;
+  AreaDownscaler* downscaler;
+  uint32_t seenGeneration;
+  bool isLocked;
+};
+
+#endif  // SOURCE_HUB_H
@@ -0,0 +1,171 @@
+#ifndef TILE_ENCODER_H
+#define TILE_ENCODER_H
+
+#include <stdint.h>
+#include <string.h>
+#include <list>
+#include <unordered_map>
+#include "Frame.h"
+#include "ImageDiffRLECompressor.h"
+#include "Protocol.h"
+
+#define TILE_HASH_PRIME 0x100000001b3ULL
+#define TILE_BLANK_SLOT 0
+#define TILE_NO_SLOT -1
+#define TILE_MAP_ENTRY_SIZE 2
+
+class TileEncoder {
+ public:
+  uint32_t uploadedTiles;
+
+  TileEncoder() { reset(); }
+
+  void reset() {
+    slotsByHash.clear();
+    leastRecentlyUsed.clear();
+    memset(slots, 0, sizeof(slots));
+    memset(map, TILE_BLANK_SLOT, sizeof(map));
+
+    // (slot 0 is a blank tile that is never evicted)
+    slotsByHash[hash(slots[TILE_BLANK_SLOT])] = TILE_BLANK_SLOT;
+    for (int i = 1; i < TILE_SLOTS; i++) {
+      slotHashes[i] = 0;
+      leastRecentlyUsed.push_back(i);
+      positionsInList[i] = std::prev(leastRecentlyUsed.end());
+    }
+  }
+
+  void encode(Frame& frame, ImageDiffRLECompressor& diffs) {
+    // (the output uses the temporal diff wire format: one bit per map cell,
+    //  followed by a non-RLE payload with the new map entries and tiles)
+    uint8_t tiles[TILE_MAP_CELLS][TILE_BYTES];
+    uint64_t hashes[TILE_MAP_CELLS];
+    int foundSlots[TILE_MAP_CELLS];
+
+    uploadedTiles = 0;
+    diffs.totalCompressedPixels = diffs.repeatedPixels = 0;
+    diffs.startPixel = TILE_MAP_CELLS;
+    diffs.temporalDiffEndPacket = TEMPORAL_DIFF_MAX_PACKETS(TILE_MAP_CELLS);
+    memset(diffs.temporalDiffs, 0, TEMPORAL_DIFF_MAX_SIZE(TILE_MAP_CELLS));
+
+    // (first, all resident tiles are touched so they can't be evicted)
+    forEachCell([&frame, &tiles, &hashes, &foundSlots, this](uint32_t cell,
+                                                            uint32_t x,
+                                                            uint32_t y) {
+      for (int row = 0; row < TILE_SIZE; row++)
+        memcpy(tiles[cell] + row * TILE_SIZE,
+               frame.raw8BitPixels + (y + row) * DRAW_WIDTH + x, TILE_SIZE);
+      hashes[cell] = hash(tiles[cell]);
+      foundSlots[cell] = find(hashes[cell], tiles[cell]);
+      if (foundSlots[cell] != TILE_NO_SLOT)
+        touch(foundSlots[cell]);
+    });
+
+    forEachCell([&diffs, &tiles, &hashes, &foundSlots, this](
+                    uint32_t cell, uint32_t x, uint32_t y) {
+      int slot = foundSlots[cell];
+      if (slot == TILE_NO_SLOT)
+        slot = find(hashes[cell], tiles[cell]);  // (uploaded in this frame)
+      if (slot != TILE_NO_SLOT && map[cell] == slot)
+        return;
+
+      bool isNew = slot == TILE_NO_SLOT;
+      uint32_t size = TILE_MAP_ENTRY_SIZE + (isNew ? TILE_BYTES : 0);
+      if (diffs.totalCompressedPixels + size > TOTAL_SCREEN_PIXELS)
+        return;  // (no more room: the cell stays dirty for the next frame)
+
+      if (isNew) {
+        slot = evict();
+        store(slot, hashes[cell], tiles[cell]);
+        uploadedTiles++;
+      }
+
+      uint16_t entry = slot | (isNew ? TILE_NEW_BIT_MASK : 0);
+      uint8_t* payload = diffs.compressedPixels + diffs.totalCompressedPixels;
+      payload[0] = entry & 0xff;
+      payload[1] = entry >> 8;
+      if (isNew)
+        memcpy(payload + TILE_MAP_ENTRY_SIZE, tiles[cell], TILE_BYTES);
+      diffs.totalCompressedPixels += size;
+
+      map[cell] = slot;
+      markAsChanged(diffs, cell);
+    });
+
+    if (diffs.lastChangedPixelId > -1)
+      diffs.temporalDiffEndPacket =
+          (diffs.lastChangedPixelId / 8) / PACKET_SIZE + 1;
+  }
+
+ private:
+  uint8_t slots[TILE_SLOTS][TILE_BYTES];
+  uint64_t slotHashes[TILE_SLOTS];
+  std::unordered_map<uint64_t, uint16_t> slotsByHash;
+  std::list<uint16_t> leastRecentlyUsed;
+  std::list<uint16_t>::iterator positionsInList[TILE_SLOTS];
+  uint16_t map[TILE_MAP_CELLS];
+
+  template <typename F>
+  void forEachCell(F action) {
+    for (uint32_t y = 0; y < DRAW_HEIGHT; y += TILE_SIZE)
+      for (uint32_t x = 0; x < DRAW_WIDTH; x += TILE_SIZE)
+        action((y / TILE_SIZE) * TILE_MAP_WIDTH + x / TILE_SIZE, x, y);
+  }
+
+  int find(uint64_t tileHash, uint8_t* tile) {
+    auto match = slotsByHash.find(tileHash);
+    if (match == slotsByHash.end() ||
+        memcmp(slots[match->second], tile, TILE_BYTES) != 0)
+      return TILE_NO_SLOT;
+
+    return match->second;
+  }
+
+  void touch(uint16_t slot) {
+    if (slot == TILE_BLANK_SLOT)
+      return;
+
+    leastRecentlyUsed.splice(leastRecentlyUsed.end(), leastRecentlyUsed,
+                             positionsInList[slot]);
+  }
+
+  uint16_t evict() {
+    // (slots used in this frame are at the end of the list, and there are
+    //  more slots than cells, so the first one is always free to evict)
+    uint16_t slot = leastRecentlyUsed.front();
+    auto match = slotsByHash.find(slotHashes[slot]);
+    if (match != slotsByHash.end() && match->second == slot)
+      slotsByHash.erase(match);
+
+    return slot;
+  }
+
+  void store(uint16_t slot, uint64_t tileHash, uint8_t* tile) {
+    memcpy(slots[slot], tile, TILE_BYTES);
+    slotHashes[slot] = tileHash;
+    slotsByHash[tileHash] = slot;
+    touch(slot);
+  }
+
+  void markAsChanged(ImageDiffRLECompressor& diffs, uint32_t cell) {
+    if (diffs.startPixel == TILE_MAP_CELLS)
+      diffs.startPixel = cell;
+    diffs.temporalDiffs[cell / 8] |= 1 << (cell % 8);
+    diffs.lastChangedPixelId = cell;
+  }
+
+  uint64_t hash(uint8_t* tile) {
+    uint64_t result = 0;
+
+    for (int i = 0; i < TILE_BYTES; i += sizeof(uint64_t)) {
+      uint64_t word;
+      memcpy(&word, tile + i, sizeof(uint64_t));
+      result = (result ^ word) * TILE_HASH_PRIME;
+      result ^= result >> 32;
+    }
+
+    return result;
+  }
+};
+
+#endif  // TILE_ENCODER_H
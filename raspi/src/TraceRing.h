@@ -0,0 +1,182 @@
+#ifndef TRACE_RING_H
+#define TRACE_RING_H
+
+#include <signal.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Utils.h"
+
+// An always-on, in-memory trace of the last events of a station.
+// Recording an event costs a clock read and a 16-byte copy. The ring is
+// dumped to a binary file (TRACE_FILE) on resets and on SIGUSR1, and
+// `out/trace-to-chrome.run` converts the dumps to Chrome/Perfetto JSON.
+//   kill -USR1 $(pidof raspi.run)
+
+#define TRACE_RING_EVENTS 65536  // (a power of two)
+#define TRACE_MAGIC 0x45435254   // ("TRCE")
+#define TRACE_VERSION 1
+
+// EVENT PHASES
+#define TRACE_BEGIN 0
+#define TRACE_END 1
+#define TRACE_INSTANT 2
+
+// ENCODING DECISION (value of TRACE_ENCODING)
+#define TRACE_ENCODING_RLE 0b1
+#define TRACE_ENCODING_INTERLACED 0b10
+#define TRACE_ENCODING_PACKED 0b100
+#define TRACE_ENCODING_TILES 0b1000
+#define TRACE_ENCODING_SCAN_ORDER_OFFSET 4
+#define TRACE_ENCODING_PACKETS_OFFSET 16
+
+enum TraceName {
+  TRACE_FRAME,        // (begin: frame number)
+  TRACE_BUILD,        //
+  TRACE_DIFFS,        //
+  TRACE_SYNC,         // (begin: command, end: 1 if synced)
+  TRACE_STREAM,       // (begin: sync command, end: sent packets)
+  TRACE_RECOVERY,     // (begin: packet index, end: requested index)
+  TRACE_RESET,        // (instant)
+  TRACE_DUPLICATE,    // (instant)
+  TRACE_ENCODING,     // (instant: TRACE_ENCODING_* flags)
+  TRACE_RENDER_MODE,  // (instant: new render mode)
+  TRACE_NAMES
+};
+
+const std::string TRACE_NAME_TEXTS[TRACE_NAMES] = {
+    "frame",    "build",     "diffs",    "sync",     "stream",
+    "recovery", "reset",     "duplicate", "encoding", "render mode"};
+
+typedef struct {
+  uint64_t timestamp;  // (steady clock, in nanoseconds)
+  uint16_t name;
+  uint16_t phase;
+  uint32_t value;
+} TraceEvent;
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t station;
+  uint32_t totalEvents;  // (then, the events from oldest to newest)
+} TraceHeader;
+
+class TraceRing {
+ public:
+  TraceRing(std::string fileName, uint32_t station) {
+    this->fileName = fileName;
+    this->station = station;
+    events = new TraceEvent[TRACE_RING_EVENTS];
+    totalEvents = 0;
+    seenRequests = requests();
+    isWriting = false;
+  }
+
+  static void listenToSignal() { signal(SIGUSR1, onSignal); }
+
+  void begin(TraceName name, uint32_t value = 0) {
+    record(name, TRACE_BEGIN, value);
+  }
+
+  void end(TraceName name, uint32_t value = 0) {
+    record(name, TRACE_END, value);
+  }
+
+  void instant(TraceName name, uint32_t value = 0) {
+    record(name, TRACE_INSTANT, value);
+  }
+
+  bool isEmpty() { return totalEvents == 0; }
+
+  void dumpIfRequested() {
+    // (signals only set a flag, and each station dumps its own ring; the GBA
+    //  would time out waiting for the next frame, so a copy of the ring is
+    //  written by another thread)
+    uint32_t currentRequests = requests();
+    if (currentRequests == seenRequests)
+      return;
+
+    seenRequests = currentRequests;
+    if (fileName.empty() || isWriting)
+      return;
+
+    auto copy = new std::vector<TraceEvent>(snapshot());
+    isWriting = true;
+    std::thread([this, copy]() {
+      write(*copy);
+      delete copy;
+      isWriting = false;
+    }).detach();
+  }
+
+  void dump() {
+    if (fileName.empty() || isWriting)
+      return;
+
+    write(snapshot());
+  }
+
+  ~TraceRing() {
+    while (isWriting)
+      usleep(1000);
+    delete[] events;
+  }
+
+ private:
+  std::string fileName;
+  uint32_t station;
+  TraceEvent* events;
+  uint64_t totalEvents;
+  uint32_t seenRequests;
+  std::atomic<bool> isWriting;
+
+  void record(TraceName name, uint16_t phase, uint32_t value) {
+    TraceEvent& event = events[totalEvents % TRACE_RING_EVENTS];
+    event.timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                          std::chrono::steady_clock::now().time_since_epoch())
+                          .count();
+    event.name = name;
+    event.phase = phase;
+    event.value = value;
+    totalEvents++;
+  }
+
+  std::vector<TraceEvent> snapshot() {
+    // (from oldest to newest)
+    uint64_t count = std::min(totalEvents, (uint64_t)TRACE_RING_EVENTS);
+    std::vector<TraceEvent> copy;
+    copy.reserve(count);
+    for (uint64_t i = totalEvents - count; i < totalEvents; i++)
+      copy.push_back(events[i % TRACE_RING_EVENTS]);
+
+    return copy;
+  }
+
+  void write(const std::vector<TraceEvent>& copy) {
+    TraceHeader header = {TRACE_MAGIC, TRACE_VERSION, station,
+                          (uint32_t)copy.size()};
+
+    std::ofstream file(fileName, std::ios::binary | std::ios::trunc);
+    file.write((char*)&header, sizeof(header));
+    file.write((char*)copy.data(), copy.size() * sizeof(TraceEvent));
+
+    if (!file.good())
+      LOG("Trace error: cannot write " + fileName);
+  }
+
+  static volatile sig_atomic_t& requests() {
+    static volatile sig_atomic_t requests = 0;
+    return requests;
+  }
+
+  static void onSignal(int) { requests() = requests() + 1; }
+};
+
+#endif  // TRACE_RING_H
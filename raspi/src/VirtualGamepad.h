@@ -13,8 +13,10 @@
 #include <iostream>
 #include <streambuf>
 #include <string>
+#include <thread>
 #include <vector>
 
+#include "ButtonQueue.h"
 #include "Utils.h"
 
 #define VG_DEVFILE "/dev/uinput"
@@ -33,6 +35,8 @@
 #define VG_SEPARATOR_COMBO "+"
 #define VG_TOTAL_KEYS 10
 #define VG_TOTAL_BUTTONS 14
+#define VG_KEY_COMBINATIONS (1 << VG_TOTAL_KEYS)
+#define VG_STOP 0xffff  // (not a valid button state: it stops the thread)
 
 // (key = gba, button = rpi)
 const std::string KEY_NAMES[VG_TOTAL_KEYS] = {
@@ -69,6 +73,7 @@ typedef struct {
 
 typedef struct {
   std::vector<KeyMapping> mappings;
+  uint16_t buttons[VG_KEY_COMBINATIONS];  // (keys => bit i = BUTTONS[i])
 } KeyConfiguration;
 
 class VirtualGamepad {
@@ -88,6 +93,13 @@ class VirtualGamepad {
                        "\n";
       exit(44);
     }
+
+    // (uinput writes are syscalls, so they run out of the SPI thread)
+    inputThread = std::thread([this]() {
+      uint16_t buttons;
+      while ((buttons = queue.pop()) != VG_STOP)
+        writeButtons(buttons);
+    });
   }
 
   void setCurrentConfiguration(uint32_t configurationId) {
@@ -96,19 +108,21 @@ class VirtualGamepad {
   }
 
   void setButtons(uint16_t pressedKeys) {
-    auto configuration = configurations[currentConfiguration];
-    uint16_t usedKeys = 0;
-
-    for (auto& mapping : configuration.mappings) {
-      auto button = mapping.button;
-      setButton(button,
-                isPressed(button, pressedKeys, &usedKeys, configuration));
-    }
-
-    flush();
+    uint16_t buttons = configurations[currentConfiguration]
+                           .buttons[pressedKeys & (VG_KEY_COMBINATIONS - 1)];
+    if (buttons == queuedButtons)
+      return;
+
+    // (if the queue is full, it's retried with the next keys)
+    if (queue.push(buttons))
+      queuedButtons = buttons;
   }
 
   ~VirtualGamepad() {
+    while (!queue.push(VG_STOP))
+      std::this_thread::yield();
+    inputThread.join();
+
     ioctl(fileDescriptor, UI_DEV_DESTROY);
     close(fileDescriptor);
   }
@@ -117,6 +131,10 @@ class VirtualGamepad {
   int fileDescriptor;
   std::vector<KeyConfiguration> configurations;
   uint32_t currentConfiguration = 0;
+  uint16_t queuedButtons = 0;  // (SPI thread)
+  uint16_t writtenButtons = 0;  // (input thread)
+  ButtonQueue queue;
+  std::thread inputThread;
 
   bool isPressed(uint16_t button,
                  uint16_t pressedKeys,
@@ -129,22 +147,49 @@ class VirtualGamepad {
     return false;
   }
 
-  void setButton(uint16_t button, bool isPressed) {
-    struct input_event event;
-    memset(&event, 0, sizeof(struct input_event));
-    event.type = EV_KEY;
-    event.code = button;
-    event.value = isPressed;
-    write(fileDescriptor, &event, sizeof(struct input_event));
+  void compile(KeyConfiguration& configuration) {
+    // (runs the mappings for every key combination, in order, so the last
+    //  mapping of a button decides its state, like it used to do every frame)
+    for (uint32_t keys = 0; keys < VG_KEY_COMBINATIONS; keys++) {
+      uint16_t usedKeys = 0;
+      uint16_t buttons = 0;
+
+      for (auto& mapping : configuration.mappings) {
+        uint16_t bit = 1 << getButtonIdFromButton(mapping.button);
+        if (isPressed(mapping.button, keys, &usedKeys, configuration))
+          buttons |= bit;
+        else
+          buttons &= ~bit;
+      }
+
+      configuration.buttons[keys] = buttons;
+    }
   }
 
-  void flush() {
-    struct input_event event;
-    memset(&event, 0, sizeof(struct input_event));
-    event.type = EV_SYN;
-    event.code = SYN_REPORT;
-    event.value = 0;
-    write(fileDescriptor, &event, sizeof(struct input_event));
+  void writeButtons(uint16_t buttons) {
+    // (only the changed buttons are sent, in a single write)
+    struct input_event events[VG_TOTAL_BUTTONS + 1];
+    uint16_t changedButtons = buttons ^ writtenButtons;
+    uint32_t totalEvents = 0;
+    if (changedButtons == 0)
+      return;
+
+    memset(events, 0, sizeof(events));
+    for (int i = 0; i < VG_TOTAL_BUTTONS; i++) {
+      if (!(changedButtons & (1 << i)))
+        continue;
+
+      events[totalEvents].type = EV_KEY;
+      events[totalEvents].code = BUTTONS[i];
+      events[totalEvents].value = (buttons >> i) & 1;
+      totalEvents++;
+    }
+    events[totalEvents].type = EV_SYN;
+    events[totalEvents].code = SYN_REPORT;
+    totalEvents++;
+
+    write(fileDescriptor, events, totalEvents * sizeof(struct input_event));
+    writtenButtons = buttons;
   }
 
   void openUInput() {
@@ -211,6 +256,7 @@ class VirtualGamepad {
       if (mapping.isValid())
         configuration.mappings.push_back(mapping);
     }
+    compile(configuration);
 
     return configuration;
   }
@@ -257,6 +303,15 @@ class VirtualGamepad {
 
     return -1;
   }
+
+  int getButtonIdFromButton(uint16_t button) {
+    for (int i = 0; i < VG_TOTAL_BUTTONS; i++) {
+      if (BUTTONS[i] == button)
+        return i;
+    }
+
+    return -1;
+  }
 };
 
 #endif  // VIRTUAL_GAMEPAD_H
@@ -1,15 +1,42 @@
+#include <thread>
+#include <vector>
 #include "GBARemotePlay.h"
+#include "MetricsServer.h"
 
 int main() {
   LOG("Starting...\n");
 
-  auto remotePlay = new GBARemotePlay();
+#ifdef BENCHMARK_DITHERING
+  Benchmark::dithering();
+  return 0;
+#endif
+
+  auto config = new Config(CONFIG_FILENAME);
+  auto sourceHub = GBARemotePlay::createSourceHub(config);
+  auto metricsServer =
+      new MetricsServer(config->metricsSocket, config->totalStations);
+  if (config->relayMode != "client")
+    PALETTE_initializeCache(PALETTE_CACHE_FILENAME);
+  TraceRing::listenToSignal();
 
-  while (true) {
-    remotePlay->run();
+  // (each GBA link runs on its own thread, sharing the captured frames)
+  std::vector<std::thread> stations;
+  for (uint32_t i = 0; i < config->totalStations; i++) {
+    auto remotePlay =
+        new GBARemotePlay(config, i, sourceHub, metricsServer->station(i));
+    stations.push_back(std::thread([remotePlay]() {
+      while (true) {
+        remotePlay->run();
+      }
+    }));
   }
 
-  delete remotePlay;
+  for (auto& station : stations)
+    station.join();
+
+  delete metricsServer;
+  delete sourceHub;
+  delete config;
 
   return 0;
 }
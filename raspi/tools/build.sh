@@ -0,0 +1,22 @@
+#!/bin/bash
+
+cd "$(dirname "$0")"
+
+rm -f ../out/frame-ring.run ../out/relay-client.run ../out/trace-to-chrome.run
+
+g++ \
+  -O2 \
+  ./frame-ring.cpp \
+  -lrt \
+  -lpthread \
+  -o ../out/frame-ring.run
+
+g++ \
+  -O2 \
+  ./relay-client.cpp \
+  -o ../out/relay-client.run
+
+g++ \
+  -O2 \
+  ./trace-to-chrome.cpp \
+  -o ../out/trace-to-chrome.run
@@ -0,0 +1,105 @@
+// Stand-alone producer/consumer for the shared memory frame ring.
+// It doesn't need a Raspberry Pi, so the ring can be tested on any Linux PC:
+//   ./out/frame-ring.run produce [width] [height] [fps]
+//   ./out/frame-ring.run consume
+// Then, set FRAME_SOURCE=shm in config.cfg to make `raspi.run` consume the
+// frames instead of reading the screen.
+
+#include <stdint.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include "../src/SharedFrameRing.h"
+
+#define RING_NAME "/gba-remote-play"
+#define DEFAULT_WIDTH 240
+#define DEFAULT_HEIGHT 160
+#define DEFAULT_FPS 60
+#define SQUARE_SIZE 32
+#define CONSUMER_WAIT_US 100000
+
+void drawPattern(uint8_t* slot, uint32_t pitch, int width, int height, int t) {
+  // (scrolling color bars with a bouncing white square, so both the whole
+  //  screen and small regions change)
+  int squareX = std::abs((t * 3) % (2 * (width - SQUARE_SIZE)) -
+                         (width - SQUARE_SIZE));
+  int squareY = std::abs((t * 2) % (2 * (height - SQUARE_SIZE)) -
+                         (height - SQUARE_SIZE));
+
+  for (int y = 0; y < height; y++) {
+    uint32_t* row = (uint32_t*)(slot + y * pitch);
+    for (int x = 0; x < width; x++) {
+      bool isSquare = x >= squareX && x < squareX + SQUARE_SIZE &&
+                      y >= squareY && y < squareY + SQUARE_SIZE;
+      uint8_t bar = (((x + t) / 30) % 8);
+      uint8_t r = bar & 1 ? 0xff : 0, g = bar & 2 ? 0xff : 0,
+              b = bar & 4 ? 0xff : 0;
+      row[x] = isSquare ? 0xffffff
+                        : (r << SHARED_RING_RED_OFFSET) |
+                              (g << SHARED_RING_GREEN_OFFSET) |
+                              (b << SHARED_RING_BLUE_OFFSET);
+    }
+  }
+}
+
+int produce(uint32_t width, uint32_t height, uint32_t fps) {
+  auto ring = SharedFrameRing::create(RING_NAME, width, height);
+  auto frameDuration = std::chrono::microseconds(1000000 / fps);
+  auto nextFrame = std::chrono::steady_clock::now();
+
+  std::cout << "Producing " + std::to_string(width) + "x" +
+                   std::to_string(height) + " frames at " +
+                   std::to_string(fps) + "fps on " RING_NAME "\n";
+  for (int t = 0;; t++) {
+    drawPattern(ring->producerSlot(), ring->header->pitch, width, height, t);
+    ring->publish();
+
+    nextFrame += frameDuration;
+    std::this_thread::sleep_until(nextFrame);
+  }
+}
+
+int consume() {
+  auto ring = SharedFrameRing::open(RING_NAME);
+  auto startTime = std::chrono::steady_clock::now();
+  uint32_t newFrames = 0, checks = 0;
+
+  std::cout << "Consuming " + std::to_string(ring->header->width) + "x" +
+                   std::to_string(ring->header->height) + " frames\n";
+  while (true) {
+    bool isNew;
+    uint8_t* frame = ring->acquire(CONSUMER_WAIT_US, &isNew);
+    checks++;
+    if (isNew)
+      newFrames++;
+
+    auto elapsed = std::chrono::steady_clock::now() - startTime;
+    if (elapsed >= std::chrono::seconds(1)) {
+      std::cout << std::to_string(newFrames) + " new frames (" +
+                       std::to_string(checks) + " acquires), sequence " +
+                       std::to_string(ring->header->sequence.load()) +
+                       ", first pixel " +
+                       std::to_string(*(uint32_t*)frame) + "\n";
+      startTime = std::chrono::steady_clock::now();
+      newFrames = checks = 0;
+    }
+  }
+}
+
+int main(int argc, char* argv[]) {
+  std::string command = argc > 1 ? argv[1] : "";
+
+  if (command == "produce")
+    return produce(argc > 2 ? std::stoi(argv[2]) : DEFAULT_WIDTH,
+                   argc > 3 ? std::stoi(argv[3]) : DEFAULT_HEIGHT,
+                   argc > 4 ? std::stoi(argv[4]) : DEFAULT_FPS);
+  else if (command == "consume")
+    return consume();
+
+  std::cout << "Usage: frame-ring.run produce [width] [height] [fps]\n"
+               "       frame-ring.run consume\n";
+  return 1;
+}
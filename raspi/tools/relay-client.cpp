@@ -0,0 +1,49 @@
+// Stand-alone relay client that pretends to be a GBA, so a relay encoder can
+// be tested without a link cable (or on localhost):
+//   ./out/raspi.run                                 (with RELAY_MODE=encoder)
+//   ./out/relay-client.run [address] [renderMode]
+// Each frame is "transferred" at a fixed simulated SPI speed, and the keys are
+// always released.
+
+#include <stdint.h>
+#include <unistd.h>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include "../src/EncodedFrame.h"
+#include "../src/FrameRelay.h"
+
+#define DEFAULT_ADDRESS "127.0.0.1:5555"
+#define SIMULATED_PACKET_US 15  // (~2.6Mhz plus the per-packet delay)
+
+int main(int argc, char* argv[]) {
+  std::string address = argc > 1 ? argv[1] : DEFAULT_ADDRESS;
+  uint32_t renderMode = argc > 2 ? std::stoi(argv[2]) : DEFAULT_RENDER_MODE;
+  auto relay = new FrameRelay(address, false);
+  auto frame = new EncodedFrame();
+
+  while (true) {
+    relay->waitForPeer();
+    if (!relay->sendReset(CMD_RESET | (renderMode & RENDER_MODE_BIT_MASK)))
+      continue;
+
+    auto startTime = std::chrono::steady_clock::now();
+    uint32_t packets = 0, frames = 0, totalPackets = 0;
+    while (relay->sendRequest(0, packets, packets * SIMULATED_PACKET_US) &&
+           relay->receiveFrame(*frame)) {
+      packets = frame->totalPackets();
+      usleep(packets * SIMULATED_PACKET_US);
+      frames++;
+      totalPackets += packets;
+
+      auto elapsed = std::chrono::steady_clock::now() - startTime;
+      if (elapsed >= std::chrono::seconds(1)) {
+        std::cout << std::to_string(frames) + " frames, " +
+                         std::to_string(totalPackets / frames) +
+                         " packets per frame\n";
+        startTime = std::chrono::steady_clock::now();
+        frames = totalPackets = 0;
+      }
+    }
+  }
+}
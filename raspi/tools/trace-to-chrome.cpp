@@ -0,0 +1,126 @@
+// Converts trace dumps (TRACE_FILE) to the Chrome trace format, which can be
+// opened in chrome://tracing or https://ui.perfetto.dev:
+//   ./out/trace-to-chrome.run trace.bin [trace.bin.2 ...] > trace.json
+// Every station is a thread, and all dumps share the same clock.
+
+#include <stdint.h>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "../src/TraceRing.h"
+
+typedef struct {
+  TraceHeader header;
+  std::vector<TraceEvent> events;
+} TraceDump;
+
+bool readDump(std::string fileName, TraceDump& dump) {
+  std::ifstream file(fileName, std::ios::binary);
+  if (!file.read((char*)&dump.header, sizeof(TraceHeader)) ||
+      dump.header.magic != TRACE_MAGIC ||
+      dump.header.version != TRACE_VERSION)
+    return false;
+
+  dump.events.resize(dump.header.totalEvents);
+  return (bool)file.read((char*)dump.events.data(),
+                         dump.events.size() * sizeof(TraceEvent));
+}
+
+std::string toHex(uint32_t value) {
+  std::stringstream stream;
+  stream << "\"0x" << std::hex << value << "\"";
+  return stream.str();
+}
+
+std::string describe(TraceEvent& event) {
+  // (the value means something different for each event)
+  std::string key = event.phase == TRACE_END ? "result" : "value";
+  std::string value = std::to_string(event.value);
+
+  switch (event.name) {
+    case TRACE_SYNC:
+    case TRACE_STREAM:
+      if (event.phase == TRACE_BEGIN)
+        return "\"command\":" + toHex(event.value);
+      break;
+    case TRACE_RESET:
+      return "\"packet\":" + toHex(event.value);
+    case TRACE_ENCODING:
+      return std::string("\"rle\":") +
+             (event.value & TRACE_ENCODING_RLE ? "true" : "false") +
+             ",\"interlaced\":" +
+             (event.value & TRACE_ENCODING_INTERLACED ? "true" : "false") +
+             ",\"packed\":" +
+             (event.value & TRACE_ENCODING_PACKED ? "true" : "false") +
+             ",\"tiles\":" +
+             (event.value & TRACE_ENCODING_TILES ? "true" : "false") +
+             ",\"scanOrder\":" +
+             std::to_string((event.value >> TRACE_ENCODING_SCAN_ORDER_OFFSET) &
+                            0b1111) +
+             ",\"packets\":" +
+             std::to_string(event.value >> TRACE_ENCODING_PACKETS_OFFSET);
+    default:
+      break;
+  }
+
+  return "\"" + key + "\":" + value;
+}
+
+int main(int argc, char* argv[]) {
+  if (argc < 2) {
+    std::cout << "Usage: " << argv[0] << " trace.bin [...] > trace.json\n";
+    return 1;
+  }
+
+  std::vector<TraceDump> dumps(argc - 1);
+  uint64_t startTime = UINT64_MAX;
+  for (int i = 1; i < argc; i++) {
+    if (!readDump(argv[i], dumps[i - 1])) {
+      std::cerr << "Error: " << argv[i] << " is not a valid trace\n";
+      return 2;
+    }
+    for (auto& event : dumps[i - 1].events)
+      startTime = std::min(startTime, event.timestamp);
+  }
+
+  const char phases[] = {'B', 'E', 'i'};
+  bool isFirst = true;
+  std::cout << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+  for (auto& dump : dumps) {
+    uint32_t depth[TRACE_NAMES] = {0};
+    std::cout << (isFirst ? "" : ",\n")
+              << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+              << dump.header.station << ",\"args\":{\"name\":\"station "
+              << dump.header.station << "\"}}";
+    isFirst = false;
+
+    for (auto& event : dump.events) {
+      if (event.name >= TRACE_NAMES || event.phase > TRACE_INSTANT)
+        continue;
+
+      // (the ring can start in the middle of a span, so unmatched ends are
+      //  skipped)
+      if (event.phase == TRACE_BEGIN)
+        depth[event.name]++;
+      else if (event.phase == TRACE_END) {
+        if (depth[event.name] == 0)
+          continue;
+        depth[event.name]--;
+      }
+
+      uint64_t time = event.timestamp - startTime;
+      std::cout << ",\n{\"name\":\"" << TRACE_NAME_TEXTS[event.name]
+                << "\",\"ph\":\"" << phases[event.phase]
+                << "\",\"pid\":1,\"tid\":" << dump.header.station
+                << ",\"ts\":" << time / 1000 << "." << (time % 1000) / 100
+                << (time % 100) / 10 << time % 10
+                << (event.phase == TRACE_INSTANT ? ",\"s\":\"t\"" : "")
+                << ",\"args\":{" << describe(event) << "}}";
+    }
+  }
+  std::cout << "\n]}\n";
+
+  return 0;
+}